@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "include/arena.h"
+
+int arena_init( Arena * a , size_t size )
+{
+  a->size = ( size + ARENA_ALIGN - 1 ) & ~( size_t ) ( ARENA_ALIGN - 1 );
+  a->used = 0;
+  a->peak = 0;
+  return posix_memalign( ( void ** ) &a->base , ARENA_ALIGN , a->size );
+}
+
+void arena_free( Arena * a )
+{
+  free( a->base );
+  a->base = NULL;
+  a->size = a->used = 0;
+}
+
+// Returns NULL when the arena is full, sizes are rounded up so every
+// allocation stays aligned.
+void * arena_alloc( Arena * a , size_t bytes )
+{
+  bytes = ( bytes + ARENA_ALIGN - 1 ) & ~( size_t ) ( ARENA_ALIGN - 1 );
+  if( bytes > a->size - a->used )
+  {
+    printf( "Frame arena exhausted, %u more bytes wanted with %u of %u used.\n" ,
+            ( unsigned ) bytes , ( unsigned ) a->used , ( unsigned ) a->size );
+    return NULL;
+  }
+  void * p = a->base + a->used;
+  a->used += bytes;
+  if( a->used > a->peak ) a->peak = a->used;
+  return p;
+}
+
+void arena_reset( Arena * a )
+{
+  a->used = 0;
+}
+
+size_t arena_mark( Arena * a )
+{
+  return a->used;
+}
+
+void arena_release( Arena * a , size_t mark )
+{
+  a->used = mark;
+}
+
+#ifdef VE_MALLOC_GUARD
+
+static int guarded = 0;
+
+int malloc_guard( int on )
+{
+  int was = guarded;
+  guarded = on;
+  return was;
+}
+
+static void trip( const char * what , size_t bytes )
+{
+  fprintf( stderr , "%s of %u bytes in the frame loop after warm-up!\n" , what , ( unsigned ) bytes );
+  abort();
+}
+
+void * __real_malloc( size_t bytes );
+void * __real_calloc( size_t n , size_t bytes );
+void * __real_realloc( void * p , size_t bytes );
+
+void * __wrap_malloc( size_t bytes )
+{
+  if( guarded ) trip( "malloc" , bytes );
+  return __real_malloc( bytes );
+}
+
+void * __wrap_calloc( size_t n , size_t bytes )
+{
+  if( guarded ) trip( "calloc" , n * bytes );
+  return __real_calloc( n , bytes );
+}
+
+void * __wrap_realloc( void * p , size_t bytes )
+{
+  if( guarded ) trip( "realloc" , bytes );
+  return __real_realloc( p , bytes );
+}
+
+#else
+
+int malloc_guard( int on )
+{
+  ( void ) on;
+  return 0;
+}
+
+#endif
@@ -0,0 +1,171 @@
+#include <string.h>
+#include "include/blend.h"
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#define BLEND_NEON
+#elif defined( __SSE2__ )
+#include <emmintrin.h>
+#define BLEND_SSE2
+#endif
+
+// Draws premultiplied images over the framebuffer.
+//
+// With the colours already multiplied by alpha, drawing over is just
+// dst = src + dst * ( 255 - alpha ) / 255 for every byte, the same sum for
+// all channels and for alpha itself, which is what makes it vectorize
+// well. A sprite is mostly fully transparent around the edges and fully
+// opaque inside, so every group of pixels is checked for either first,
+// and only the ones in between are mixed. Pixels are little endian 32 bit
+// words with alpha in the top byte.
+
+typedef unsigned int u32;
+
+// The layout of a framebuffer with the given masks, non zero if the
+// colours don't each fill a byte below byte 3.
+int blend_layout( int bpp , unsigned rmask , unsigned gmask , unsigned bmask , BlendLayout * l )
+{
+  unsigned mask[3] = { rmask , gmask , bmask };
+  int offset[3] , i , b;
+  if( bpp != 3 && bpp != 4 ) return 1;
+  for( i = 0; i < 3; i++ )
+  {
+    for( b = 0; b < 3 && mask[i] != 0xFFu << ( b * 8 ); b++ );
+    if( b == 3 ) return 1;
+    offset[i] = b;
+  }
+  l->bpp = bpp;
+  l->r = offset[0];
+  l->g = offset[1];
+  l->b = offset[2];
+  return 0;
+}
+
+// Multiplies the colours of a w by h 32 bit image by its alpha, in place.
+void blend_premultiply( unsigned char * pixels , int pitch , int w , int h )
+{
+  int x , y , c;
+  for( y = 0; y < h; y++ , pixels += pitch )
+  {
+    unsigned char * p = pixels;
+    for( x = 0; x < w; x++ , p += 4 )
+      for( c = 0; c < 3; c++ )
+        p[c] = ( p[c] * p[3] + 127 ) / 255;
+  }
+}
+
+// v * f / 255, rounded
+static unsigned char scale255( int v , int f )
+{
+  int t = v * f + 128;
+  return ( t + ( t >> 8 ) ) >> 8;
+}
+
+static void over_pixel( const unsigned char * s , unsigned char * d , int bytes )
+{
+  int c , f = 255 - s[3];
+  for( c = 0; c < bytes; c++ ) d[c] = s[c] + scale255( d[c] , f );
+}
+
+static void over_row4( const u32 * s , u32 * d , int n )
+{
+  int i = 0;
+#if defined( BLEND_NEON )
+  for( ; i + 8 <= n; i += 8 )
+  {
+    uint8x8x4_t sv = vld4_u8( ( const uint8_t * ) ( s + i ) );
+    uint64_t alpha = vget_lane_u64( vreinterpret_u64_u8( sv.val[3] ) , 0 );
+    if( ! alpha ) continue;
+    if( alpha == ~( uint64_t ) 0 )
+    {
+      vst1q_u32( d + i , vld1q_u32( s + i ) );
+      vst1q_u32( d + i + 4 , vld1q_u32( s + i + 4 ) );
+      continue;
+    }
+    uint8x8x4_t dv = vld4_u8( ( const uint8_t * ) ( d + i ) );
+    uint8x8_t f = vmvn_u8( sv.val[3] );
+    int c;
+    for( c = 0; c < 4; c++ )
+    {
+      uint16x8_t t = vmull_u8( dv.val[c] , f );
+      dv.val[c] = vqadd_u8( sv.val[c] , vraddhn_u16( t , vrshrq_n_u16( t , 8 ) ) );
+    }
+    vst4_u8( ( uint8_t * ) ( d + i ) , dv );
+  }
+#elif defined( BLEND_SSE2 )
+  __m128i zero = _mm_setzero_si128() , full = _mm_set1_epi32( 255 ) , half = _mm_set1_epi16( 128 );
+  for( ; i + 4 <= n; i += 4 )
+  {
+    __m128i sv = _mm_loadu_si128( ( const __m128i * ) ( s + i ) );
+    __m128i a = _mm_srli_epi32( sv , 24 );
+    if( _mm_movemask_epi8( _mm_cmpeq_epi32( a , zero ) ) == 0xFFFF ) continue;
+    if( _mm_movemask_epi8( _mm_cmpeq_epi32( a , full ) ) == 0xFFFF )
+    {
+      _mm_storeu_si128( ( __m128i * ) ( d + i ) , sv );
+      continue;
+    }
+    __m128i dv = _mm_loadu_si128( ( const __m128i * ) ( d + i ) );
+    // 255 - alpha in all four 16 bit lanes of its pixel
+    __m128i f = _mm_sub_epi32( full , a );
+    f = _mm_or_si128( f , _mm_slli_epi32( f , 16 ) );
+    __m128i lo = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( dv , zero ) , _mm_unpacklo_epi32( f , f ) ) , half );
+    __m128i hi = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( dv , zero ) , _mm_unpackhi_epi32( f , f ) ) , half );
+    lo = _mm_srli_epi16( _mm_add_epi16( lo , _mm_srli_epi16( lo , 8 ) ) , 8 );
+    hi = _mm_srli_epi16( _mm_add_epi16( hi , _mm_srli_epi16( hi , 8 ) ) , 8 );
+    _mm_storeu_si128( ( __m128i * ) ( d + i ) , _mm_adds_epu8( sv , _mm_packus_epi16( lo , hi ) ) );
+  }
+#endif
+  for( ; i < n; i++ )
+  {
+    u32 a = s[i] >> 24;
+    if( ! a ) continue;
+    if( a == 255 ) d[i] = s[i];
+    else over_pixel( ( const unsigned char * ) ( s + i ) , ( unsigned char * ) ( d + i ) , 4 );
+  }
+}
+
+static void over_row3( const u32 * s , unsigned char * d , int n )
+{
+  int i = 0;
+#if defined( BLEND_NEON )
+  for( ; i + 8 <= n; i += 8 )
+  {
+    uint8x8x4_t sv = vld4_u8( ( const uint8_t * ) ( s + i ) );
+    uint64_t alpha = vget_lane_u64( vreinterpret_u64_u8( sv.val[3] ) , 0 );
+    if( ! alpha ) continue;
+    uint8x8x3_t dv;
+    int c;
+    if( alpha == ~( uint64_t ) 0 )
+    {
+      for( c = 0; c < 3; c++ ) dv.val[c] = sv.val[c];
+    }else
+    {
+      uint8x8_t f = vmvn_u8( sv.val[3] );
+      dv = vld3_u8( d + i * 3 );
+      for( c = 0; c < 3; c++ )
+      {
+        uint16x8_t t = vmull_u8( dv.val[c] , f );
+        dv.val[c] = vqadd_u8( sv.val[c] , vraddhn_u16( t , vrshrq_n_u16( t , 8 ) ) );
+      }
+    }
+    vst3_u8( d + i * 3 , dv );
+  }
+#endif
+  for( ; i < n; i++ )
+  {
+    const unsigned char * p = ( const unsigned char * ) ( s + i );
+    if( ! p[3] ) continue;
+    if( p[3] == 255 ) memcpy( d + i * 3 , p , 3 );
+    else over_pixel( p , d + i * 3 , 3 );
+  }
+}
+
+// Draws the w by h premultiplied image src over dst, which is bpp bytes a
+// pixel with the colours where src has them. Pitches are in bytes.
+void blend_over( const unsigned char * src , int spitch , unsigned char * dst , int dpitch , int bpp ,
+                 int w , int h )
+{
+  int y;
+  for( y = 0; y < h; y++ , src += spitch , dst += dpitch )
+    if( bpp == 4 ) over_row4( ( const u32 * ) src , ( u32 * ) dst , w );
+    else over_row3( ( const u32 * ) src , dst , w );
+}
@@ -0,0 +1,288 @@
+#include <math.h>
+#include <stdio.h>
+#include "include/constellation.h"
+#include "include/refine.h"
+
+// Finds the board among the squares.
+//
+// The markers sit on the corners of a rectangle, so seen through the camera
+// they are four squares of about the same size on the corners of a convex
+// quadrilateral whose opposite sides are about as long. The diagonals of
+// such a quadrilateral about halve each other, so instead of trying every
+// four squares, every pair of squares that could be a diagonal is hashed by
+// its midpoint. Only pairs landing on about the same midpoint with about
+// the same length are put together and checked against the board. Squares
+// are bucketed as well, so making the pairs only looks at nearby squares.
+// Both keep the search close to linear in the number of squares for
+// anything but a scene packed with similar squares.
+
+// Corners are at least this many and at most this many marker sizes apart,
+// along a side.
+#define MIN_SPACING 3.0f
+#define MAX_SPACING 10.0f
+// Largest marker on the board may be this much bigger than the smallest
+#define MAX_SIZE_RATIO 1.6f
+// How far apart the midpoints of the diagonals may be, and how different
+// their lengths, as a share of the diagonal
+#define MIDPOINT_SLACK 0.15f
+#define DIAGONAL_SLACK 0.3f
+// Worse fits than this are no board at all
+#define MAX_COST 1.0f
+// Bucket side in full resolution pixels, for squares and for midpoints
+#define BUCKET 32
+// Pairs considered at most, constellation_size makes room for them
+#define MAX_PAIRS 8192
+
+typedef struct
+{
+  float x , y;
+  float size;
+} Mark;
+
+typedef struct
+{
+  float x , y;   // Midpoint
+  float length;
+  int a , b;
+} Pair;
+
+typedef struct
+{
+  int w , h;
+  int * head; // First entry in every bucket, -1 if none
+  int * next; // Next entry in the same bucket
+} Buckets;
+
+static float dist( const Mark * a , const Mark * b )
+{
+  float dx = a->x - b->x , dy = a->y - b->y;
+  return sqrtf( dx * dx + dy * dy );
+}
+
+static int similar( const Mark * a , const Mark * b )
+{
+  return a->size <= b->size * MAX_SIZE_RATIO && b->size <= a->size * MAX_SIZE_RATIO;
+}
+
+static int clampi( int v , int lo , int hi )
+{
+  return v < lo ? lo : ( v > hi ? hi : v );
+}
+
+// Puts count points into buckets, the bucket grid has to cover them all.
+static int fill_buckets( Buckets * b , Arena * a , const float * xy , int stride , int count )
+{
+  int i , bucket;
+  b->head = ( int * ) arena_alloc( a , b->w * b->h * sizeof( int ) );
+  b->next = ( int * ) arena_alloc( a , count * sizeof( int ) + 1 );
+  if( ! b->head || ! b->next ) return 1;
+  for( i = 0; i < b->w * b->h; i++ ) b->head[i] = -1;
+  // Backwards, so every bucket lists its entries in order
+  for( i = count - 1; i >= 0; i-- )
+  {
+    const float * p = xy + i * stride;
+    bucket = clampi( p[0] / BUCKET , 0 , b->w - 1 ) + clampi( p[1] / BUCKET , 0 , b->h - 1 ) * b->w;
+    b->next[i] = b->head[bucket];
+    b->head[bucket] = i;
+  }
+  return 0;
+}
+
+static float cross( const Mark * o , const Mark * a , const Mark * b )
+{
+  return ( a->x - o->x ) * ( b->y - o->y ) - ( a->y - o->y ) * ( b->x - o->x );
+}
+
+// Puts the four marks in order around their middle, clockwise on screen as
+// y points down, and starts from the one nearest the top left. Returns how
+// badly they fit the board, or a negative number if they can't be it.
+static float fit( const Mark * marks , int * quad )
+{
+  const Mark * m[4];
+  float angle[4] , mx = 0 , my = 0 , lo , hi , side[4] , t;
+  int i , j , ti;
+  int turned[4];
+  for( i = 0; i < 4; i++ )
+  {
+    mx += marks[quad[i]].x / 4;
+    my += marks[quad[i]].y / 4;
+  }
+  for( i = 0; i < 4; i++ )
+    angle[i] = atan2f( marks[quad[i]].y - my , marks[quad[i]].x - mx );
+  for( i = 1; i < 4; i++ )
+    for( j = i; j > 0 && angle[j-1] > angle[j]; j-- )
+    {
+      t = angle[j]; angle[j] = angle[j-1]; angle[j-1] = t;
+      ti = quad[j]; quad[j] = quad[j-1]; quad[j-1] = ti;
+    }
+  for( i = 0; i < 4; i++ ) m[i] = &marks[quad[i]];
+  // Convex, every turn the same way
+  for( i = 0; i < 4; i++ )
+    if( cross( m[i] , m[( i + 1 ) % 4] , m[( i + 2 ) % 4] ) <= 0 ) return -1;
+  lo = hi = m[0]->size;
+  for( i = 0; i < 4; i++ )
+  {
+    side[i] = dist( m[i] , m[( i + 1 ) % 4] );
+    if( side[i] < m[i]->size * MIN_SPACING || side[i] > m[i]->size * MAX_SPACING ) return -1;
+    if( m[i]->size < lo ) lo = m[i]->size;
+    if( m[i]->size > hi ) hi = m[i]->size;
+  }
+  if( hi > lo * MAX_SIZE_RATIO ) return -1;
+  // Start from the top left
+  for( i = 1 , j = 0; i < 4; i++ )
+    if( m[i]->x + m[i]->y < m[j]->x + m[j]->y ) j = i;
+  for( i = 0; i < 4; i++ ) turned[i] = quad[( i + j ) % 4];
+  for( i = 0; i < 4; i++ ) quad[i] = turned[i];
+  float diag = dist( m[0] , m[2] ) / dist( m[1] , m[3] );
+  // Centroids of small squares are only good to about a pixel, so their
+  // sides fit by chance as often as not. Prefer bigger markers.
+  return ( hi - lo ) / hi
+       + fabsf( 1 - side[0] / side[2] ) + fabsf( 1 - side[1] / side[3] )
+       + fabsf( 1 - diag ) * 0.5f
+       + 1 / lo;
+}
+
+// Every pair of squares that could be a diagonal of the board. Returns how
+// many, at most MAX_PAIRS, the ones past that are only counted in dropped.
+static int make_pairs( const Mark * marks , int n , const Buckets * b , Pair * pairs , unsigned * dropped )
+{
+  int i , j , bx , by , count = 0;
+  float d , reach;
+  for( i = 0; i < n; i++ )
+  {
+    const Mark * m = &marks[i];
+    // A diagonal spans two sides, of markers up to MAX_SIZE_RATIO bigger
+    reach = m->size * MAX_SIZE_RATIO * MAX_SPACING * 1.5f;
+    int bx0 = clampi( ( m->x - reach ) / BUCKET , 0 , b->w - 1 );
+    int bx1 = clampi( ( m->x + reach ) / BUCKET , 0 , b->w - 1 );
+    int by0 = clampi( ( m->y - reach ) / BUCKET , 0 , b->h - 1 );
+    int by1 = clampi( ( m->y + reach ) / BUCKET , 0 , b->h - 1 );
+    for( by = by0; by <= by1; by++ )
+      for( bx = bx0; bx <= bx1; bx++ )
+        for( j = b->head[bx + by * b->w]; j >= 0; j = b->next[j] )
+        {
+          if( j <= i || ! similar( m , &marks[j] ) ) continue;
+          d = dist( m , &marks[j] );
+          if( d > reach || d < m->size * MIN_SPACING ) continue;
+          if( count == MAX_PAIRS )
+          {
+            ( *dropped )++;
+            continue;
+          }
+          pairs[count++] = ( Pair ) { ( m->x + marks[j].x ) / 2 , ( m->y + marks[j].y ) / 2 , d , i , j };
+        }
+  }
+  return count;
+}
+
+static void set_corners( const SquareTable * t , Constellation * c )
+{
+  int i;
+  for( i = 0; i < 4; i++ )
+  {
+    c->x[i] = t->fx[c->index[i]];
+    c->y[i] = t->fy[c->index[i]];
+  }
+}
+
+// Checks whether the four squares at index are still the board, without
+// searching. Returns non zero if they don't fit it.
+int match_known( const SquareTable * t , const int * index , Constellation * c )
+{
+  Mark marks[4];
+  int quad[4] = { 0 , 1 , 2 , 3 };
+  int i;
+  float cost;
+  for( i = 0; i < 4; i++ )
+  {
+    marks[i].x = ( float ) t->fx[index[i]] / REFINE_ONE;
+    marks[i].y = ( float ) t->fy[index[i]] / REFINE_ONE;
+    marks[i].size = ( t->w[index[i]] + t->h[index[i]] ) / 2.0f;
+  }
+  cost = fit( marks , quad );
+  if( cost < 0 || cost >= MAX_COST ) return 1;
+  c->cost = cost;
+  for( i = 0; i < 4; i++ ) c->index[i] = index[quad[i]];
+  set_corners( t , c );
+  return 0;
+}
+
+// Arena bytes match_constellation needs for a w by h frame with up to
+// squares squares.
+size_t constellation_size( int w , int h , int squares )
+{
+  return MAX_PAIRS * ( sizeof( Pair ) + sizeof( int ) ) + squares * ( sizeof( Mark ) + sizeof( int ) ) +
+         2 * ( w / BUCKET + 1 ) * ( h / BUCKET + 1 ) * sizeof( int ) + 8 * ARENA_ALIGN;
+}
+
+// Squares are looked for in a w by h frame. Pairs lost to MAX_PAIRS are
+// counted in s, if there is one. Returns non zero if no four squares fit
+// the board well enough.
+int match_constellation( const SquareTable * t , int w , int h , Constellation * c , Arena * a , MatchStats * s )
+{
+  size_t mark = arena_mark( a );
+  if( s ) s->searches++;
+  int n = t->count;
+  int i , p , q , bx , by , count;
+  unsigned dropped = 0;
+  int quad[4];
+  float cost , best = MAX_COST , slack;
+  Buckets squares , mids;
+  Mark * marks = ( Mark * ) arena_alloc( a , n * sizeof( Mark ) + 1 );
+  Pair * pairs = ( Pair * ) arena_alloc( a , MAX_PAIRS * sizeof( Pair ) );
+  squares.w = mids.w = w / BUCKET + 1;
+  squares.h = mids.h = h / BUCKET + 1;
+  if( n < 4 || ! marks || ! pairs ) goto none;
+  for( i = 0; i < n; i++ )
+  {
+    marks[i].x = ( float ) t->fx[i] / REFINE_ONE;
+    marks[i].y = ( float ) t->fy[i] / REFINE_ONE;
+    marks[i].size = ( t->w[i] + t->h[i] ) / 2.0f;
+  }
+  if( fill_buckets( &squares , a , &marks[0].x , sizeof( Mark ) / sizeof( float ) , n ) ) goto none;
+  count = make_pairs( marks , n , &squares , pairs , &dropped );
+  if( s && dropped )
+  {
+    s->truncated++;
+    s->dropped += dropped;
+  }
+  if( fill_buckets( &mids , a , &pairs[0].x , sizeof( Pair ) / sizeof( float ) , count ) ) goto none;
+  for( p = 0; p < count; p++ )
+  {
+    const Pair * d = &pairs[p];
+    slack = d->length * MIDPOINT_SLACK;
+    int bx0 = clampi( ( d->x - slack ) / BUCKET , 0 , mids.w - 1 );
+    int bx1 = clampi( ( d->x + slack ) / BUCKET , 0 , mids.w - 1 );
+    int by0 = clampi( ( d->y - slack ) / BUCKET , 0 , mids.h - 1 );
+    int by1 = clampi( ( d->y + slack ) / BUCKET , 0 , mids.h - 1 );
+    for( by = by0; by <= by1; by++ )
+      for( bx = bx0; bx <= bx1; bx++ )
+        for( q = mids.head[bx + by * mids.w]; q >= 0; q = mids.next[q] )
+        {
+          const Pair * e = &pairs[q];
+          if( q <= p || e->a == d->a || e->a == d->b || e->b == d->a || e->b == d->b ) continue;
+          if( fabsf( e->x - d->x ) > slack || fabsf( e->y - d->y ) > slack ) continue;
+          if( fabsf( e->length - d->length ) > d->length * DIAGONAL_SLACK ) continue;
+          quad[0] = d->a;
+          quad[1] = d->b;
+          quad[2] = e->a;
+          quad[3] = e->b;
+          cost = fit( marks , quad );
+          if( cost < 0 || cost >= best ) continue;
+          best = cost;
+          for( i = 0; i < 4; i++ ) c->index[i] = quad[i];
+        }
+  }
+none:
+  arena_release( a , mark );
+  if( best >= MAX_COST ) return 1;
+  c->cost = best;
+  set_corners( t , c );
+  return 0;
+}
+
+void match_report( const MatchStats * s )
+{
+  printf( "Board searches: %u, %u over %d pairs, %llu pairs dropped.\n" ,
+          s->searches , s->truncated , MAX_PAIRS , s->dropped );
+}
@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include "include/contour.h"
+
+// Border following after Suzuki and Abe. Starting on the first cell of a
+// group, which has nothing set to its left or above, the walk looks for the
+// next border cell by turning counterclockwise from where it came from. It
+// only touches cells next to the border, so the cost follows the perimeter
+// and not the area of the group.
+
+static const int stepx[8] = { 1 , 1 , 0 , -1 , -1 , -1 , 0 , 1 };
+static const int stepy[8] = { 0 , -1 , -1 , -1 , 0 , 1 , 1 , 1 };
+
+static int is_set( const byte * mask , int w , int h , int x , int y )
+{
+  return x >= 0 && y >= 0 && x < w && y < h && mask[x + y * w];
+}
+
+// Squared distance of p from the line through a and b, times |ab|^2.
+static long long line_distance( Point a , Point b , Point p )
+{
+  long long dx = b.x - a.x;
+  long long dy = b.y - a.y;
+  long long cross = dx * ( p.y - a.y ) - dy * ( p.x - a.x );
+  if( ! dx && ! dy )
+  {
+    dx = p.x - a.x;
+    dy = p.y - a.y;
+    return dx * dx + dy * dy;
+  }
+  return cross * cross;
+}
+
+// Douglas-Peucker over pts[first..last], marking the points to keep. stack
+// needs room for one pair per point.
+static void simplify( const Point * pts , byte * keep , int * stack , int first , int last , int epsilon )
+{
+  int top = 0;
+  int i , far , a , b;
+  long long d , best , len;
+  stack[top++] = first;
+  stack[top++] = last;
+  while( top )
+  {
+    b = stack[--top];
+    a = stack[--top];
+    far = -1;
+    best = 0;
+    for( i = a + 1; i < b; i++ )
+    {
+      d = line_distance( pts[a] , pts[b] , pts[i] );
+      if( d > best )
+      {
+        best = d;
+        far = i;
+      }
+    }
+    len = ( long long ) ( pts[b].x - pts[a].x ) * ( pts[b].x - pts[a].x ) +
+          ( long long ) ( pts[b].y - pts[a].y ) * ( pts[b].y - pts[a].y );
+    if( ! len ) len = 1;
+    if( far < 0 || best <= ( long long ) epsilon * epsilon * len ) continue;
+    keep[far] = 1;
+    stack[top++] = a;
+    stack[top++] = far;
+    stack[top++] = far;
+    stack[top++] = b;
+  }
+}
+
+// Turns the chain into the cells where its direction changes, then thins
+// those down to the corners that stick out more than epsilon cells.
+static void build_polygon( Arena * a , Contour * c , int epsilon )
+{
+  int i , n , far , kept;
+  long long d , best;
+  size_t start = arena_mark( a );
+  Point * pts = ( Point * ) arena_alloc( a , sizeof( Point ) * ( c->length + 2 ) );
+  if( ! pts ) return;
+  Point p = { c->x , c->y };
+  n = 0;
+  pts[n++] = p;
+  for( i = 0; i < c->length; i++ )
+  {
+    p.x += stepx[c->chain[i]];
+    p.y += stepy[c->chain[i]];
+    if( i + 1 < c->length && c->chain[i+1] != c->chain[i] ) pts[n++] = p;
+  }
+  pts[n] = pts[0]; // Closed, the last step lands on the start again
+  c->polygon = pts;
+  c->corners = n;
+  if( n < 4 ) return;
+  size_t mark = arena_mark( a );
+  byte * keep = ( byte * ) arena_alloc( a , n + 1 );
+  int * stack = ( int * ) arena_alloc( a , sizeof( int ) * 2 * ( n + 1 ) );
+  if( ! keep || ! stack )
+  {
+    arena_release( a , mark );
+    return;
+  }
+  // Split the ring at the start and the vertex furthest from it
+  far = 0;
+  best = 0;
+  for( i = 1; i < n; i++ )
+  {
+    d = line_distance( pts[0] , pts[0] , pts[i] );
+    if( d > best )
+    {
+      best = d;
+      far = i;
+    }
+  }
+  for( i = 0; i <= n; i++ ) keep[i] = 0;
+  keep[0] = keep[far] = 1;
+  simplify( pts , keep , stack , 0 , far , epsilon );
+  simplify( pts , keep , stack , far , n , epsilon );
+  kept = 0;
+  for( i = 0; i < n; i++ )
+    if( keep[i] ) pts[kept++] = pts[i];
+  c->corners = kept;
+  // Only the corners stay
+  arena_release( a , start + ( ( sizeof( Point ) * kept + ARENA_ALIGN - 1 ) & ~( ARENA_ALIGN - 1 ) ) );
+}
+
+// Traces the outer border of the group whose first cell in row-major order
+// is (x, y). Walks at most maxsteps, and neighbours follow connectivity,
+// which should match the one used for labeling. Returns NULL if a is full.
+Contour * trace_contour( Arena * a , const byte * mask , int w , int h , int x , int y ,
+                         int connectivity , int maxsteps , int epsilon )
+{
+  int step = connectivity == 8 ? 1 : 2;
+  int d , k , back , n;
+  int cx , cy , nx , ny;
+  int firstx , firsty;
+  Contour * c = ( Contour * ) arena_alloc( a , sizeof( Contour ) );
+  if( ! c ) return NULL;
+  size_t mark = arena_mark( a );
+  *c = ( Contour ) { x , y , 0 , NULL , 0 , NULL };
+  c->chain = ( byte * ) arena_alloc( a , maxsteps );
+  if( ! c->chain ) return NULL;
+  // Clockwise from the west neighbour for the cell the walk ends on
+  for( k = 0 , d = 4; k < 8 / step; k++ )
+  {
+    d = ( d - step ) & 7;
+    if( is_set( mask , w , h , x + stepx[d] , y + stepy[d] ) ) break;
+  }
+  if( k < 8 / step )
+  {
+    firstx = x + stepx[d];
+    firsty = y + stepy[d];
+    back = d; // Direction from the current cell to the previous one
+    cx = x;
+    cy = y;
+    n = 0;
+    while( n < maxsteps )
+    {
+      // Counterclockwise from just past where we came from
+      for( k = 0 , d = back; k < 8 / step; k++ )
+      {
+        d = ( d + step ) & 7;
+        if( is_set( mask , w , h , cx + stepx[d] , cy + stepy[d] ) ) break;
+      }
+      nx = cx + stepx[d];
+      ny = cy + stepy[d];
+      c->chain[n++] = d;
+      if( nx == x && ny == y && cx == firstx && cy == firsty ) break;
+      back = ( d + 4 ) & 7;
+      cx = nx;
+      cy = ny;
+    }
+    c->length = n;
+  }
+  // Hand back what the chain didn't use
+  arena_release( a , mark + ( ( c->length + ARENA_ALIGN - 1 ) & ~( ARENA_ALIGN - 1 ) ) );
+  build_polygon( a , c , epsilon );
+  return c;
+}
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "include/filters.h"
+#include "include/moments.h"
+
+const char * rule_names[RULE_COUNT] =
+{
+  "min_count" ,
+  "max_count" ,
+  "min_width" ,
+  "max_width" ,
+  "min_height" ,
+  "max_height" ,
+  "max_eccentricity" ,
+  "min_fill"
+};
+
+// Groups only ever grow while labeling, so once one is past a maximum it
+// can be given up on before it is done.
+static const int growing[RULE_COUNT] = { 0 , 1 , 0 , 1 , 0 , 1 , 0 , 0 };
+
+void filter_defaults( BlobFilter * f )
+{
+  memset( f , 0 , sizeof( BlobFilter ) );
+  f->limit[RULE_MIN_COUNT] = 6;
+  f->limit[RULE_MAX_COUNT] = INT_MAX;
+  f->limit[RULE_MIN_WIDTH] = 4;
+  f->limit[RULE_MAX_WIDTH] = INT_MAX;
+  f->limit[RULE_MIN_HEIGHT] = 4;
+  f->limit[RULE_MAX_HEIGHT] = INT_MAX;
+  f->limit[RULE_MAX_ECCENTRICITY] = 91; // A rectangle 145% as high as wide
+  f->limit[RULE_MIN_FILL] = 180;
+}
+
+// Lines of "rule value", # starts a comment. Rules left out keep their
+// defaults, returns non zero if the file can't be read.
+int filter_load( BlobFilter * f , const char * fname )
+{
+  char line[128] , name[64];
+  int value , i;
+  filter_defaults( f );
+  FILE * file = fopen( fname , "r" );
+  if( ! file ) return 1;
+  while( fgets( line , sizeof( line ) , file ) )
+  {
+    if( sscanf( line , "%63s %d" , name , &value ) != 2 || name[0] == '#' ) continue;
+    for( i = 0; i < RULE_COUNT; i++ )
+      if( ! strcmp( name , rule_names[i] ) ) break;
+    if( i == RULE_COUNT )
+      printf( "Unknown filter rule %s in %s\n" , name , fname );
+    else
+      f->limit[i] = value;
+  }
+  fclose( file );
+  return 0;
+}
+
+// The first rule the blob fails, -1 if it passes. Only checks the rules that
+// can't recover when growing is set.
+static int failed_rule( const BlobFilter * f , const Blob * b , int onlygrowing )
+{
+  int values[RULE_COUNT];
+  int i;
+  values[RULE_MIN_COUNT] = values[RULE_MAX_COUNT] = b->count;
+  values[RULE_MIN_WIDTH] = values[RULE_MAX_WIDTH] = b->maxx - b->minx + 1;
+  values[RULE_MIN_HEIGHT] = values[RULE_MAX_HEIGHT] = b->maxy - b->miny + 1;
+  if( onlygrowing )
+  {
+    for( i = 1; i < RULE_MAX_ECCENTRICITY; i += 2 )
+      if( values[i] > f->limit[i] ) return i;
+    return -1;
+  }
+  for( i = 0; i < RULE_MAX_ECCENTRICITY; i++ )
+    if( growing[i] ? values[i] > f->limit[i] : values[i] < f->limit[i] ) return i;
+  Moments m;
+  blob_moments( b , &m );
+  if( m.eccentricity > f->limit[RULE_MAX_ECCENTRICITY] ) return RULE_MAX_ECCENTRICITY;
+  if( m.fill < f->limit[RULE_MIN_FILL] ) return RULE_MIN_FILL;
+  return -1;
+}
+
+// For groups still being labeled, marks them dropped if they already broke
+// a maximum. Returns non zero if so.
+int filter_hopeless( const BlobFilter * f , Blob * b )
+{
+  int rule;
+  if( b->status != BLOB_OPEN ) return b->status != BLOB_PASSED;
+  rule = failed_rule( f , b , 1 );
+  if( rule < 0 ) return 0;
+  b->status = BLOB_DROPPED;
+  b->rule = rule;
+  return 1;
+}
+
+// Decides a group that is complete, counting the rule that turned it down.
+void filter_close( const BlobFilter * f , Blob * b , unsigned * rejects )
+{
+  if( b->status == BLOB_OPEN )
+  {
+    b->rule = failed_rule( f , b , 0 );
+    b->status = b->rule < 0 ? BLOB_PASSED : BLOB_DROPPED;
+  }
+  if( b->status == BLOB_DROPPED )
+  {
+    rejects[b->rule]++;
+    b->status = BLOB_REJECTED;
+  }
+}
+
+// Filters complete groups after the fact, keeping the ones that pass at the
+// front in order. Returns how many did.
+int filter_blobs( BlobFilter * f , Blob * blobs , int count )
+{
+  int i , kept = 0;
+  for( i = 0; i < count; i++ )
+  {
+    filter_close( f , &blobs[i] , f->rejects );
+    if( blobs[i].status == BLOB_PASSED ) blobs[kept++] = blobs[i];
+  }
+  return kept;
+}
+
+void filter_report( const BlobFilter * f )
+{
+  int i;
+  printf( "Rejected groups per rule:\n" );
+  for( i = 0; i < RULE_COUNT; i++ )
+    printf( "  %-16s %11d %u\n" , rule_names[i] , f->limit[i] , f->rejects[i] );
+}
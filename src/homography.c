@@ -0,0 +1,75 @@
+#include "include/homography.h"
+
+// Closed form for the unit square to a quadrilateral, after Heckbert's
+// "Fundamentals of Texture Mapping and Image Warping". Corners (0,0),
+// (1,0), (1,1) and (0,1) go to the four points in order. Returns non zero
+// if three of them are on a line.
+int homography_square_to_quad( Homography * h , const float * x , const float * y )
+{
+  float sx = x[0] - x[1] + x[2] - x[3];
+  float sy = y[0] - y[1] + y[2] - y[3];
+  float * m = h->m;
+  if( sx == 0 && sy == 0 )
+  {
+    // A parallelogram, the map is affine
+    m[0] = x[1] - x[0]; m[1] = x[2] - x[1]; m[2] = x[0];
+    m[3] = y[1] - y[0]; m[4] = y[2] - y[1]; m[5] = y[0];
+    m[6] = 0;           m[7] = 0;           m[8] = 1;
+    return m[0] * m[4] == m[1] * m[3];
+  }
+  float dx1 = x[1] - x[2] , dx2 = x[3] - x[2];
+  float dy1 = y[1] - y[2] , dy2 = y[3] - y[2];
+  float det = dx1 * dy2 - dx2 * dy1;
+  if( det == 0 ) return 1;
+  float g = ( sx * dy2 - dx2 * sy ) / det;
+  float k = ( dx1 * sy - sx * dy1 ) / det;
+  m[0] = x[1] - x[0] + g * x[1]; m[1] = x[3] - x[0] + k * x[3]; m[2] = x[0];
+  m[3] = y[1] - y[0] + g * y[1]; m[4] = y[3] - y[0] + k * y[3]; m[5] = y[0];
+  m[6] = g;                      m[7] = k;                      m[8] = 1;
+  return 0;
+}
+
+// The w by hgt rectangle from the origin onto the quadrilateral, corners
+// clockwise on screen from the origin.
+int homography_rect_to_quad( Homography * h , float w , float hgt , const float * x , const float * y )
+{
+  int i;
+  if( w <= 0 || hgt <= 0 || homography_square_to_quad( h , x , y ) ) return 1;
+  for( i = 0; i < 3; i++ )
+  {
+    h->m[i*3] /= w;
+    h->m[i*3+1] /= hgt;
+  }
+  return 0;
+}
+
+// Through the adjugate, scaled so m8 is 1 where it can be. Returns non zero
+// if h is singular.
+int homography_invert( const Homography * h , Homography * inv )
+{
+  const float * a = h->m;
+  float * b = inv->m;
+  b[0] = a[4] * a[8] - a[5] * a[7];
+  b[1] = a[2] * a[7] - a[1] * a[8];
+  b[2] = a[1] * a[5] - a[2] * a[4];
+  b[3] = a[5] * a[6] - a[3] * a[8];
+  b[4] = a[0] * a[8] - a[2] * a[6];
+  b[5] = a[2] * a[3] - a[0] * a[5];
+  b[6] = a[3] * a[7] - a[4] * a[6];
+  b[7] = a[1] * a[6] - a[0] * a[7];
+  b[8] = a[0] * a[4] - a[1] * a[3];
+  float det = a[0] * b[0] + a[1] * b[3] + a[2] * b[6];
+  if( det == 0 ) return 1;
+  float s = 1 / ( b[8] != 0 ? b[8] : det );
+  int i;
+  for( i = 0; i < 9; i++ ) b[i] *= s;
+  return 0;
+}
+
+void homography_apply( const Homography * h , float x , float y , float * ox , float * oy )
+{
+  const float * m = h->m;
+  float w = 1 / ( m[6] * x + m[7] * y + m[8] );
+  *ox = ( m[0] * x + m[1] * y + m[2] ) * w;
+  *oy = ( m[3] * x + m[4] * y + m[5] ) * w;
+}
@@ -0,0 +1,28 @@
+#ifndef __H_ARENA__
+#define __H_ARENA__
+
+#include <stddef.h>
+
+// Bump allocator for everything that only lives for one frame.
+typedef struct
+{
+  char * base;
+  size_t size;
+  size_t used;
+  size_t peak; // Highest use seen, for sizing
+} Arena;
+
+#define ARENA_ALIGN 16
+
+int arena_init( Arena * a , size_t size );
+void arena_free( Arena * a );
+void * arena_alloc( Arena * a , size_t bytes );
+void arena_reset( Arena * a );
+size_t arena_mark( Arena * a );
+void arena_release( Arena * a , size_t mark );
+
+// With VE_MALLOC_GUARD, and malloc wrapped at link time, any heap allocation
+// made while the guard is on aborts. Returns whether it was on before.
+int malloc_guard( int on );
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef __H_BLEND__
+#define __H_BLEND__
+
+// Where red, green and blue sit in a 24 or 32 bit pixel, as byte offsets.
+// Images blended onto it keep their colours in the same bytes, with alpha
+// in byte 3.
+typedef struct
+{
+  int bpp;
+  int r , g , b;
+} BlendLayout;
+
+int blend_layout( int bpp , unsigned rmask , unsigned gmask , unsigned bmask , BlendLayout * l );
+void blend_premultiply( unsigned char * pixels , int pitch , int w , int h );
+void blend_over( const unsigned char * src , int spitch , unsigned char * dst , int dpitch , int bpp ,
+                 int w , int h );
+
+#endif
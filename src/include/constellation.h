@@ -0,0 +1,29 @@
+#ifndef __H_CONSTELLATION__
+#define __H_CONSTELLATION__
+
+#include "squares.h"
+
+// The four markers of the board, as the best fitting quadrilateral among
+// the squares.
+typedef struct
+{
+  int index[4];     // Squares at the corners, clockwise on screen from the top left
+  int x[4] , y[4];  // Their refined centroids, in REFINE_ONE units
+  float cost;       // How badly they fit the board, 0 is perfect
+  int id[4];        // Track ids of the corners, 0 if not tracked yet
+} Constellation;
+
+// How often the pair limit of the matcher was hit, see match_report.
+typedef struct
+{
+  unsigned searches;     // match_constellation calls
+  unsigned truncated;    // Calls that had more pairs than MAX_PAIRS
+  unsigned long long dropped; // Pairs never looked at because of it
+} MatchStats;
+
+size_t constellation_size( int w , int h , int squares );
+int match_constellation( const SquareTable * t , int w , int h , Constellation * c , Arena * a , MatchStats * s );
+void match_report( const MatchStats * s );
+int match_known( const SquareTable * t , const int * index , Constellation * c );
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef __H_CONTOUR__
+#define __H_CONTOUR__
+
+#include "label.h"
+#include "arena.h"
+
+typedef struct
+{
+  int x , y;
+} Point;
+
+// Outer border of a group. Freeman codes, 0 is +x, 2 is -y (up), and codes
+// go counterclockwise on screen.
+typedef struct
+{
+  int x , y;       // First cell of the group in row-major order
+  int length;      // Steps in chain, the walk ends back on (x, y)
+  byte * chain;
+  int corners;     // Vertices of the simplified outline
+  Point * polygon; // In cell coordinates
+} Contour;
+
+Contour * trace_contour( Arena * a , const byte * mask , int w , int h , int x , int y ,
+                         int connectivity , int maxsteps , int epsilon );
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef __H_FILTERS__
+#define __H_FILTERS__
+
+#include "label.h"
+
+// Rules a group has to pass to count as a marker. Sizes are in cells of the
+// level it was found on, shape limits in MOMENT_ONE units.
+enum
+{
+  RULE_MIN_COUNT ,
+  RULE_MAX_COUNT ,
+  RULE_MIN_WIDTH ,
+  RULE_MAX_WIDTH ,
+  RULE_MIN_HEIGHT ,
+  RULE_MAX_HEIGHT ,
+  RULE_MAX_ECCENTRICITY ,
+  RULE_MIN_FILL ,
+  RULE_COUNT
+};
+
+typedef struct
+{
+  int limit[RULE_COUNT];
+  unsigned rejects[RULE_COUNT]; // Groups each rule turned down so far
+} BlobFilter;
+
+extern const char * rule_names[RULE_COUNT];
+
+void filter_defaults( BlobFilter * f );
+int filter_load( BlobFilter * f , const char * fname );
+int filter_hopeless( const BlobFilter * f , Blob * b );
+void filter_close( const BlobFilter * f , Blob * b , unsigned * rejects );
+int filter_blobs( BlobFilter * f , Blob * blobs , int count );
+void filter_report( const BlobFilter * f );
+
+#endif
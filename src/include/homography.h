@@ -0,0 +1,16 @@
+#ifndef __H_HOMOGRAPHY__
+#define __H_HOMOGRAPHY__
+
+// Projective map of the plane, row major. (x, y) goes to
+// ( m0 x + m1 y + m2 , m3 x + m4 y + m5 ) / ( m6 x + m7 y + m8 ).
+typedef struct
+{
+  float m[9];
+} Homography;
+
+int homography_square_to_quad( Homography * h , const float * x , const float * y );
+int homography_rect_to_quad( Homography * h , float w , float hgt , const float * x , const float * y );
+int homography_invert( const Homography * h , Homography * inv );
+void homography_apply( const Homography * h , float x , float y , float * ox , float * oy );
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef __H_LABEL__
+#define __H_LABEL__
+
+typedef unsigned char byte;
+
+typedef struct
+{
+  byte colour;
+  int id;
+} Unit;
+
+typedef struct
+{
+  short w,h;
+  Unit * units;
+} Cell;
+
+// A horizontal stretch of set cells, end is exclusive.
+typedef struct
+{
+  short start , end;
+  short y;
+  int label;
+} Run;
+
+typedef struct
+{
+  int w , h;
+  int count;      // Runs in use
+  Run * runs;     // Room for the worst case, w/2 runs per row
+  int * rowstart; // Runs of row y are [rowstart[y], rowstart[y+1])
+} RunMask;
+
+// Blob.status, a group is open until labeling has seen all of it. Dropped
+// groups broke a rule but have not been counted yet, rejected ones have.
+#define BLOB_OPEN 0
+#define BLOB_PASSED 1
+#define BLOB_DROPPED 2
+#define BLOB_REJECTED 3
+
+// Stats of a group, filled in while labeling.
+typedef struct
+{
+  int status;
+  int rule;                        // The filter rule it broke, if dropped
+  int count;
+  int minx , maxx , miny , maxy;
+  int firstx;                      // Column of the first cell, on row miny
+  int sumx , sumy;                 // For the centroid
+  long long sumxx , sumyy , sumxy; // For the second order moments
+} Blob;
+
+int label_table_size( int w , int h );
+int label_unite( int * parent , Blob * blobs , int a , int b );
+int label_resolve( int * parent , Blob * blobs , int next );
+void blob_start( Blob * b , int x , int y );
+void blob_add_run( Blob * b , int start , int end , int y );
+int label_cell( Cell * cell , int connectivity , int * parent , Blob * blobs );
+
+int runs_init( RunMask * rm , int w , int h );
+void runs_free( RunMask * rm );
+void runs_reset( RunMask * rm );
+void runs_add_row( RunMask * rm , const byte * mask , int y );
+void runs_add_spans( RunMask * rm , const byte * mask , int y , const int * spans , int n );
+int label_runs( RunMask * rm , int connectivity , int * parent , Blob * blobs );
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef __H_LENS__
+#define __H_LENS__
+
+#include <stddef.h>
+
+// Source coordinates are stored as 16.16 fixed point.
+#define LENS_SHIFT 16
+#define LENS_ONE ( 1 << LENS_SHIFT )
+
+typedef struct
+{
+  int x , y;
+} LensPoint;
+
+typedef struct
+{
+  float fx , fy; // Focal length in full resolution pixels
+  float cx , cy; // Principal point
+  float k1 , k2; // Radial distortion
+  float p1 , p2; // Tangential distortion
+} LensCalibration;
+
+typedef struct
+{
+  int w , h;       // Size of the grid the table covers
+  int scale;       // Full resolution pixels per grid cell
+  LensPoint * map; // For every grid cell, where to sample the full frame
+  void * mapping;  // mmapped cache file, including the header
+  size_t mapsize;
+} LensMap;
+
+int lens_load_calibration( const char * fname , LensCalibration * cal );
+int lens_save_calibration( const char * fname , const LensCalibration * cal );
+int lens_open( LensMap * lens , const LensCalibration * cal , const char * cachename ,
+               int w , int h , int scale , int fw , int fh );
+void lens_close( LensMap * lens );
+void lens_bounds( const LensMap * lens , int x0 , int y0 , int x1 , int y1 ,
+                  int * sx0 , int * sy0 , int * sx1 , int * sy1 );
+int lens_undistort( const LensMap * lens , float sx , float sy , float * gx , float * gy );
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef __H_MOMENTS__
+#define __H_MOMENTS__
+
+#include "label.h"
+
+// Everything here is fixed point with 8 fractional bits.
+#define MOMENT_SHIFT 8
+#define MOMENT_ONE ( 1 << MOMENT_SHIFT )
+
+typedef struct
+{
+  int cx , cy;            // Centroid, in cells
+  int mu20 , mu02 , mu11; // Central second moments per cell, in cells^2
+  int angle;              // Major axis from +x towards +y, radians in (-pi/2, pi/2]
+  int eccentricity;       // (l1 - l2) / (l1 + l2) of the moment eigenvalues, 0 when round
+  int fill;               // Share of the equally spread rectangle covered, ONE when solid
+} Moments;
+
+void blob_moments( const Blob * b , Moments * m );
+int fixed_atan2( int y , int x );
+
+#endif
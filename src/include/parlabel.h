@@ -0,0 +1,23 @@
+#ifndef __H_PARLABEL__
+#define __H_PARLABEL__
+
+#include "label.h"
+#include "filters.h"
+
+#ifndef LABEL_THREADS
+#define LABEL_THREADS 4
+#endif
+
+// Below this many runs per strip the hand-off costs more than it saves.
+// Waking a worker and waiting for it takes about as long as labeling a
+// thousand runs on one thread, so on the 128x96 grid only masks far busier
+// than a few markers get more than one strip.
+#ifndef MIN_STRIP_RUNS
+#define MIN_STRIP_RUNS 1024
+#endif
+
+int parlabel_init( int threads );
+void parlabel_quit();
+int parlabel_runs( RunMask * rm , int connectivity , int threads , BlobFilter * filter , int * parent , Blob * blobs );
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __H_POSE__
+#define __H_POSE__
+
+#include "homography.h"
+#include "lens.h"
+
+// Where the board is relative to the camera. Camera coordinates have x
+// right, y down and z forward, in the units the board size was given in.
+typedef struct
+{
+  float r[9]; // Rotation, row major, board axes in camera coordinates as columns
+  float t[3]; // Board centre
+} Pose;
+
+int pose_from_homography( const LensCalibration * cal , const Homography * h ,
+                          float w , float hgt , Pose * p );
+void pose_to_vector( const Pose * p , float * v );
+void pose_from_vector( const float * v , Pose * p );
+
+// Views of the board collected for solving the intrinsics.
+#define CALIB_MAX_VIEWS 32
+#define CALIB_MIN_VIEWS 3
+
+typedef struct
+{
+  int views;
+  Homography h[CALIB_MAX_VIEWS]; // Board plane onto the image
+} Calibration;
+
+void calib_reset( Calibration * c );
+int calib_add( Calibration * c , const Homography * h );
+int calib_solve( const Calibration * c , float scale , LensCalibration * cal );
+
+#endif
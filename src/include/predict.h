@@ -0,0 +1,23 @@
+#ifndef __H_PREDICT__
+#define __H_PREDICT__
+
+#define AB_MAX 8
+
+// Constant velocity alpha-beta filter over up to AB_MAX values. Times are
+// in seconds.
+typedef struct
+{
+  int n;
+  float alpha , beta;     // How much of the error goes into the value and the rate
+  float coast;            // Seconds to keep predicting without measurements
+  float x[AB_MAX];        // Value at time t
+  float v[AB_MAX];        // Change per second
+  double t;
+  int valid;
+} AlphaBeta;
+
+void ab_init( AlphaBeta * f , int n , float alpha , float beta , float coast );
+void ab_update( AlphaBeta * f , const float * z , double t );
+int ab_predict( AlphaBeta * f , double t , float * out );
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef __H_REFINE__
+#define __H_REFINE__
+
+#include "label.h"
+
+// Refined positions have 8 fractional bits.
+#define REFINE_SHIFT 8
+#define REFINE_ONE ( 1 << REFINE_SHIFT )
+
+int refine_centroid( const byte * rgb , int w , int x0 , int y0 , int x1 , int y1 ,
+                     int base , int * cx , int * cy );
+
+#endif
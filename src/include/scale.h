@@ -0,0 +1,13 @@
+#ifndef __H_SCALE__
+#define __H_SCALE__
+
+#include "arena.h"
+
+#define SCALE_BILINEAR 1 // Filter between pixels instead of taking the nearest
+
+size_t scale_size( int maxw );
+int scale_image( const unsigned char * src , int sw , int sh , int spitch ,
+                 unsigned char * dst , int dw , int dh , int dpitch , int bpp ,
+                 int x , int y , int w , int h , int flags , Arena * a );
+
+#endif
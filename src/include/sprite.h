@@ -0,0 +1,35 @@
+#ifndef __H_SPRITE__
+#define __H_SPRITE__
+
+#include "arena.h"
+
+// Scaled copies kept at once, and scales per doubling in size
+#define SPRITE_SLOTS 6
+#define SPRITE_STEPS 8
+
+typedef struct
+{
+  int step;              // Scale is 2^(step/SPRITE_STEPS)
+  int w , h;             // Size at that scale, from the top left of pixels
+  unsigned used;         // Clock when last drawn, 0 if empty
+  unsigned char * pixels;
+} SpriteSlot;
+
+// A 32 bit image kept ready at a few quantised scales, reusing the least
+// recently drawn slot for a new scale.
+typedef struct
+{
+  const unsigned char * image; // Not owned, has to outlive the cache
+  int imagew , imageh , imagepitch;
+  int maxw , maxh;       // Biggest scaled copy a slot holds
+  int pitch;             // Of every slot, in bytes
+  unsigned clock;
+  unsigned hits , misses;
+  SpriteSlot slots[SPRITE_SLOTS];
+} SpriteCache;
+
+int sprite_init( SpriteCache * c , const unsigned char * image , int w , int h , int pitch , int maxw , int maxh );
+void sprite_free( SpriteCache * c );
+const unsigned char * sprite_get( SpriteCache * c , float scale , int * w , int * h , Arena * a );
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef __H_SQUARES__
+#define __H_SQUARES__
+
+#include "arena.h"
+#include "contour.h"
+
+// Marker candidates, one array per field. The passes after labeling each
+// read a few fields of every square, so they only pull those through the
+// cache, and their loops are plain enough for the compiler to vectorize.
+// Every array comes from an arena and is ARENA_ALIGN aligned.
+typedef struct
+{
+  int count;
+  int capacity;
+  int * x , * y;         // Box corner in full resolution pixels
+  int * w , * h;         // Box size in full resolution pixels
+  int * size;            // Mean of the box sides less a cell, what sorting goes by
+  int * area;            // Cells in the group, on its level
+  int * cx , * cy;       // Centroid in full resolution pixels
+  int * fx , * fy;       // The same in REFINE_ONE units, refined on the full frame
+  int * angle;           // Moments of the group, see Moments
+  int * eccentricity;
+  int * fill;
+  Contour ** outline;    // Corners scaled to full resolution, NULL if not traced
+} SquareTable;
+
+// Int fields above, for sizing
+#define SQUARE_INT_FIELDS 13
+
+size_t squares_size( int capacity );
+int squares_init( SquareTable * t , Arena * a , int capacity );
+void squares_swap( SquareTable * t , int i , int j );
+int squares_compact( SquareTable * t , const unsigned char * keep );
+
+// Fills scores[i] for every square, higher is better.
+typedef void ( * SquareScore )( const SquareTable * t , int * scores );
+
+void score_size( const SquareTable * t , int * scores );
+void score_mean_size( const SquareTable * t , int * scores );
+int squares_top( const SquareTable * t , SquareScore score , int k , int * out , Arena * a );
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef __H_TRACK__
+#define __H_TRACK__
+
+#include "arena.h"
+#include "predict.h"
+#include "squares.h"
+
+#define MAX_TRACKS 64
+// Sizes may differ by this much between frames
+#define MAX_SIZE_CHANGE 1.5f
+
+// One square followed from frame to frame. Positions are the refined
+// centroids in full resolution pixels.
+typedef struct
+{
+  int id;              // Never reused, 0 is no track
+  int hits;            // Frames matched in a row
+  int confirmed;       // Seen TRACK_CONFIRM frames in a row at some point
+  int misses;          // Frames missed in a row
+  int square;          // Square it matched this frame, -1 if none
+  AlphaBeta f;         // x, y and size, f.v is the velocity in pixels a second
+} Track;
+
+typedef struct
+{
+  int count;
+  int next_id;
+  Track tracks[MAX_TRACKS];
+} Tracker;
+
+void tracker_init( Tracker * tr );
+size_t tracker_size( int squares );
+void tracker_update( Tracker * tr , const SquareTable * t , double time , int * ids , Arena * a );
+const Track * tracker_find( const Tracker * tr , int id );
+
+#endif
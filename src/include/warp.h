@@ -0,0 +1,13 @@
+#ifndef __H_WARP__
+#define __H_WARP__
+
+#include "homography.h"
+
+#define WARP_BILINEAR 1 // Filter between texels instead of taking the nearest
+#define WARP_BLEND 2    // Keep the alpha of the image, otherwise it comes out opaque
+
+void warp_image( const unsigned char * src , int sw , int sh , int spitch ,
+                 unsigned char * dst , int dpitch , int ox , int oy , int w , int h ,
+                 const Homography * tosrc , int flags );
+
+#endif
@@ -0,0 +1,274 @@
+#include <stdlib.h>
+#include "include/label.h"
+
+// Two-pass connected component labeling with a union-find equivalence table.
+//
+// The first pass hands out provisional labels in row-major order and records
+// which of them touch. Unions always hang the larger root under the smaller
+// one, so every entry points at a smaller label and each root is the first
+// label its group got in the scan. The second pass can then number the roots
+// in one ascending sweep, giving the same ids a seed fill scanning for its
+// next seed in row-major order would.
+//
+// Group stats are kept on the roots as cells are labeled, and folded into the
+// surviving root whenever two labels are unified, so nothing has to walk the
+// grid again afterwards. Stats of label l live in blobs[l-1].
+
+// A checkerboard is the worst case, every other unit gets a new label.
+int label_table_size( int w , int h )
+{
+  return ( w * h + 1 ) / 2 + 1;
+}
+
+static int find_root( int * parent , int l )
+{
+  int root = l;
+  int next;
+  while( parent[root] != root ) root = parent[root];
+  // Path compression
+  while( parent[l] != root )
+  {
+    next = parent[l];
+    parent[l] = root;
+    l = next;
+  }
+  return root;
+}
+
+static void blob_merge( Blob * dst , const Blob * src )
+{
+  // Only groups still being labeled meet, and a dropped one stays dropped
+  if( src->status == BLOB_DROPPED && dst->status != BLOB_DROPPED )
+  {
+    dst->status = BLOB_DROPPED;
+    dst->rule = src->rule;
+  }
+  dst->count += src->count;
+  dst->sumx += src->sumx;
+  dst->sumy += src->sumy;
+  dst->sumxx += src->sumxx;
+  dst->sumyy += src->sumyy;
+  dst->sumxy += src->sumxy;
+  if( src->minx < dst->minx ) dst->minx = src->minx;
+  if( src->maxx > dst->maxx ) dst->maxx = src->maxx;
+  if( src->miny < dst->miny ) dst->miny = src->miny;
+  if( src->maxy > dst->maxy ) dst->maxy = src->maxy;
+}
+
+// Joins the groups of a and b, a being 0 meaning no group yet. Returns the
+// root the two share now.
+int label_unite( int * parent , Blob * blobs , int a , int b )
+{
+  if( ! a ) return find_root( parent , b );
+  a = find_root( parent , a );
+  b = find_root( parent , b );
+  if( a == b ) return a;
+  if( a > b )
+  {
+    int t = a;
+    a = b;
+    b = t;
+  }
+  parent[b] = a;
+  blob_merge( &blobs[a-1] , &blobs[b-1] );
+  return a;
+}
+
+// Sum of 0^2 .. n^2
+static long long square_sum( long long n )
+{
+  return n * ( n + 1 ) * ( 2 * n + 1 ) / 6;
+}
+
+void blob_add_run( Blob * b , int start , int end , int y )
+{
+  int len = end - start;
+  int sumx = ( start + end - 1 ) * len / 2;
+  b->count += len;
+  b->sumx += sumx;
+  b->sumy += y * len;
+  b->sumxx += square_sum( end - 1 ) - square_sum( start - 1 );
+  b->sumyy += ( long long ) y * y * len;
+  b->sumxy += ( long long ) y * sumx;
+  if( start < b->minx ) b->minx = start;
+  if( end - 1 > b->maxx ) b->maxx = end - 1;
+  if( y < b->miny ) b->miny = y;
+  if( y > b->maxy ) b->maxy = y;
+}
+
+void blob_start( Blob * b , int x , int y )
+{
+  *b = ( Blob ) { BLOB_OPEN , -1 , 0 , x , x , y , y , x , 0 , 0 , 0 , 0 , 0 };
+}
+
+// Numbers the roots in order, moving their stats down to blobs[id-1]. A root
+// never has a lower label than its id, so this only overwrites slots that
+// were already dealt with. Ids are stored negated in parent, labels below
+// next that were never handed out have to be 0. Rejected groups get id 0.
+int label_resolve( int * parent , Blob * blobs , int next )
+{
+  int l;
+  int count = 0;
+  for( l = 1; l < next; l++ )
+  {
+    if( ! parent[l] ) continue;
+    if( parent[l] == l && blobs[l-1].status == BLOB_REJECTED )
+      parent[l] = 0;
+    else if( parent[l] == l )
+    {
+      parent[l] = -( ++count );
+      blobs[count-1] = blobs[l-1];
+    }else
+      parent[l] = parent[parent[l]];
+  }
+  return count;
+}
+
+// Labels the units with colour 0xFF, ids start at 1. connectivity is 4 or 8,
+// parent and blobs need label_table_size entries. Returns the number of
+// groups, whose stats end up in the first entries of blobs.
+int label_cell( Cell * cell , int connectivity , int * parent , Blob * blobs )
+{
+  int w = cell->w;
+  int h = cell->h;
+  int x , y , l , count;
+  int next = 1;
+  Unit * row = cell->units;
+  Unit * up;
+  for( y = 0; y < h; y++ , row += w )
+  {
+    up = row - w;
+    for( x = 0; x < w; x++ )
+    {
+      if( row[x].colour != 0xFF )
+      {
+        row[x].id = 0;
+        continue;
+      }
+      l = 0;
+      if( x > 0 && row[x-1].colour == 0xFF ) l = row[x-1].id;
+      if( y > 0 )
+      {
+        if( up[x].colour == 0xFF ) l = label_unite( parent , blobs , l , up[x].id );
+        if( connectivity == 8 )
+        {
+          if( x > 0 && up[x-1].colour == 0xFF ) l = label_unite( parent , blobs , l , up[x-1].id );
+          if( x < w - 1 && up[x+1].colour == 0xFF ) l = label_unite( parent , blobs , l , up[x+1].id );
+        }
+      }
+      if( ! l )
+      {
+        l = next++;
+        parent[l] = l;
+        blob_start( &blobs[l-1] , x , y );
+      }else
+        l = find_root( parent , l );
+      row[x].id = l;
+      blob_add_run( &blobs[l-1] , x , x + 1 , y );
+    }
+  }
+  count = label_resolve( parent , blobs , next );
+  row = cell->units;
+  for( x = 0; x < w * h; x++ )
+    if( row[x].id ) row[x].id = -parent[row[x].id];
+  return count;
+}
+
+// Run based labeling. The thresholding pass turns every row into a list of
+// runs as it goes, and labeling only ever looks at those, so a mostly empty
+// mask costs next to nothing no matter the resolution.
+
+int runs_init( RunMask * rm , int w , int h )
+{
+  rm->w = w;
+  rm->h = h;
+  rm->count = 0;
+  rm->runs = ( Run * ) malloc( h * ( ( w + 1 ) / 2 ) * sizeof( Run ) );
+  rm->rowstart = ( int * ) calloc( h + 1 , sizeof( int ) );
+  return ! rm->runs || ! rm->rowstart;
+}
+
+void runs_free( RunMask * rm )
+{
+  free( rm->runs );
+  free( rm->rowstart );
+  rm->runs = NULL;
+  rm->rowstart = NULL;
+}
+
+void runs_reset( RunMask * rm )
+{
+  rm->count = 0;
+}
+
+// Rows have to be added in order, starting at 0.
+void runs_add_row( RunMask * rm , const byte * mask , int y )
+{
+  int all[2] = { 0 , rm->w };
+  runs_add_spans( rm , mask , y , all , 1 );
+}
+
+// Same, but only looks at the cells in n spans of the row, given as start
+// and end pairs in order. Spans must not touch, the mask has to be clear
+// between them.
+void runs_add_spans( RunMask * rm , const byte * mask , int y , const int * spans , int n )
+{
+  Run * run = rm->runs + rm->count;
+  int s , x , w;
+  rm->rowstart[y] = rm->count;
+  for( s = 0; s < n; s++ )
+  {
+    x = spans[s*2];
+    w = spans[s*2+1];
+    while( x < w )
+    {
+      while( x < w && ! mask[x] ) x++;
+      if( x == w ) break;
+      run->start = x;
+      run->y = y;
+      while( x < w && mask[x] ) x++;
+      run->end = x;
+      run++;
+    }
+  }
+  rm->count = run - rm->runs;
+  rm->rowstart[y+1] = rm->count;
+}
+
+// Same numbering as label_cell. parent and blobs need one entry per run plus
+// one, a new label is the index of the run that started it plus one.
+int label_runs( RunMask * rm , int connectivity , int * parent , Blob * blobs )
+{
+  // With 8-connectivity runs that only touch diagonally are joined too
+  int reach = connectivity == 8 ? 1 : 0;
+  int y , i , p , q , l , count;
+  Run * runs = rm->runs;
+  for( y = 0; y < rm->h; y++ )
+  {
+    p = y > 0 ? rm->rowstart[y-1] : 0;
+    int prevend = y > 0 ? rm->rowstart[y] : 0;
+    for( i = rm->rowstart[y]; i < rm->rowstart[y+1]; i++ )
+    {
+      Run * r = &runs[i];
+      // Skip runs above that end before this one starts, they can't touch
+      // anything further right either.
+      while( p < prevend && runs[p].end + reach <= r->start ) p++;
+      l = 0;
+      for( q = p; q < prevend && runs[q].start < r->end + reach; q++ )
+        l = label_unite( parent , blobs , l , runs[q].label );
+      if( ! l )
+      {
+        l = i + 1;
+        parent[l] = l;
+        blob_start( &blobs[l-1] , r->start , y );
+      }else
+        parent[i+1] = 0; // Never handed out
+      r->label = l;
+      blob_add_run( &blobs[l-1] , r->start , r->end , y );
+    }
+  }
+  count = label_resolve( parent , blobs , rm->count + 1 );
+  for( i = 0; i < rm->count; i++ )
+    runs[i].label = -parent[runs[i].label];
+  return count;
+}
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "include/lens.h"
+
+#define LENS_MAGIC 0x4D4C4556 // "VELM"
+#define LENS_VERSION 1
+
+// Everything the table depends on, so a stale cache can be detected.
+typedef struct
+{
+  int magic;
+  int version;
+  int w , h , scale , fw , fh;
+  LensCalibration cal;
+} LensHeader;
+
+int lens_load_calibration( const char * fname , LensCalibration * cal )
+{
+  FILE * f = fopen( fname , "r" );
+  if( ! f ) return 1;
+  int n = fscanf( f , "%f %f %f %f %f %f %f %f" ,
+                  &cal->fx , &cal->fy , &cal->cx , &cal->cy ,
+                  &cal->k1 , &cal->k2 , &cal->p1 , &cal->p2 );
+  fclose( f );
+  if( n != 8 || cal->fx <= 0 || cal->fy <= 0 )
+  {
+    printf( "Malformed lens calibration in %s\n" , fname );
+    return 1;
+  }
+  return 0;
+}
+
+int lens_save_calibration( const char * fname , const LensCalibration * cal )
+{
+  FILE * f = fopen( fname , "w" );
+  if( ! f ) return 1;
+  fprintf( f , "%f %f %f %f %f %f %f %f\n" ,
+           cal->fx , cal->fy , cal->cx , cal->cy , cal->k1 , cal->k2 , cal->p1 , cal->p2 );
+  return fclose( f ) != 0;
+}
+
+static int clampi( int v , int lo , int hi )
+{
+  return v < lo ? lo : ( v > hi ? hi : v );
+}
+
+// Brown-Conrady model: for an undistorted pixel, find where the lens put it.
+static void build_map( LensPoint * map , const LensHeader * hd )
+{
+  const LensCalibration * c = &hd->cal;
+  int gx , gy;
+  for( gy = 0; gy < hd->h; gy++ )
+  for( gx = 0; gx < hd->w; gx++ )
+  {
+    float xn = ( gx * hd->scale - c->cx ) / c->fx;
+    float yn = ( gy * hd->scale - c->cy ) / c->fy;
+    float r2 = xn * xn + yn * yn;
+    float radial = 1 + r2 * ( c->k1 + r2 * c->k2 );
+    float xd = xn * radial + 2 * c->p1 * xn * yn + c->p2 * ( r2 + 2 * xn * xn );
+    float yd = yn * radial + c->p1 * ( r2 + 2 * yn * yn ) + 2 * c->p2 * xn * yn;
+    map[gx + gy * hd->w] = ( LensPoint )
+    {
+      clampi( ( xd * c->fx + c->cx ) * LENS_ONE , 0 , ( hd->fw - 1 ) << LENS_SHIFT ) ,
+      clampi( ( yd * c->fy + c->cy ) * LENS_ONE , 0 , ( hd->fh - 1 ) << LENS_SHIFT )
+    };
+  }
+}
+
+static int map_cache( LensMap * lens , const LensHeader * hd , const char * cachename )
+{
+  int fd = open( cachename , O_RDONLY );
+  if( fd < 0 ) return 1;
+  struct stat st;
+  size_t size = sizeof( LensHeader ) + hd->w * hd->h * sizeof( LensPoint );
+  if( fstat( fd , &st ) || st.st_size != ( off_t ) size )
+  {
+    close( fd );
+    return 1;
+  }
+  void * m = mmap( NULL , size , PROT_READ , MAP_SHARED , fd , 0 );
+  close( fd );
+  if( m == MAP_FAILED ) return 1;
+  if( memcmp( m , hd , sizeof( LensHeader ) ) )
+  {
+    munmap( m , size );
+    return 1;
+  }
+  lens->mapping = m;
+  lens->mapsize = size;
+  lens->map = ( LensPoint * ) ( ( char * ) m + sizeof( LensHeader ) );
+  return 0;
+}
+
+static int write_cache( const LensHeader * hd , const char * cachename )
+{
+  size_t count = hd->w * hd->h;
+  LensPoint * map = ( LensPoint * ) malloc( count * sizeof( LensPoint ) );
+  if( ! map ) return 1;
+  build_map( map , hd );
+  FILE * f = fopen( cachename , "wb" );
+  int failed = ! f;
+  if( f )
+  {
+    failed |= fwrite( hd , sizeof( LensHeader ) , 1 , f ) != 1;
+    failed |= fwrite( map , sizeof( LensPoint ) , count , f ) != count;
+    failed |= fclose( f ) != 0;
+  }
+  free( map );
+  return failed;
+}
+
+int lens_open( LensMap * lens , const LensCalibration * cal , const char * cachename ,
+               int w , int h , int scale , int fw , int fh )
+{
+  LensHeader hd;
+  // Zero the padding too, the header is compared bytewise
+  memset( &hd , 0 , sizeof( hd ) );
+  hd.magic = LENS_MAGIC;
+  hd.version = LENS_VERSION;
+  hd.w = w;
+  hd.h = h;
+  hd.scale = scale;
+  hd.fw = fw;
+  hd.fh = fh;
+  hd.cal = *cal;
+  memset( lens , 0 , sizeof( LensMap ) );
+  lens->w = w;
+  lens->h = h;
+  lens->scale = scale;
+  if( ! map_cache( lens , &hd , cachename ) ) return 0;
+  printf( "Lens table cache missing or stale, rebuilding %s\n" , cachename );
+  if( write_cache( &hd , cachename ) )
+  {
+    printf( "Failed to write lens table to %s\n" , cachename );
+    return 1;
+  }
+  return map_cache( lens , &hd , cachename );
+}
+
+void lens_close( LensMap * lens )
+{
+  if( lens->mapping ) munmap( lens->mapping , lens->mapsize );
+  lens->mapping = NULL;
+  lens->map = NULL;
+}
+
+// Box in the full frame holding everything the lens imaged into grid cells
+// [x0, x1) x [y0, y1), in whole pixels with x1 and y1 exclusive.
+void lens_bounds( const LensMap * lens , int x0 , int y0 , int x1 , int y1 ,
+                  int * sx0 , int * sy0 , int * sx1 , int * sy1 )
+{
+  int x , y;
+  LensPoint p;
+  x0 = clampi( x0 , 0 , lens->w - 1 );
+  y0 = clampi( y0 , 0 , lens->h - 1 );
+  x1 = clampi( x1 , x0 + 1 , lens->w );
+  y1 = clampi( y1 , y0 + 1 , lens->h );
+  *sx0 = *sy0 = 1 << 30;
+  *sx1 = *sy1 = 0;
+  for( y = y0; y < y1; y++ )
+    for( x = x0; x < x1; x++ )
+    {
+      p = lens->map[x + y * lens->w];
+      if( p.x < *sx0 ) *sx0 = p.x;
+      if( p.y < *sy0 ) *sy0 = p.y;
+      if( p.x > *sx1 ) *sx1 = p.x;
+      if( p.y > *sy1 ) *sy1 = p.y;
+    }
+  *sx0 >>= LENS_SHIFT;
+  *sy0 >>= LENS_SHIFT;
+  *sx1 = ( *sx1 >> LENS_SHIFT ) + 1;
+  *sy1 = ( *sy1 >> LENS_SHIFT ) + 1;
+}
+
+// Finds the grid position the lens imaged at (sx, sy) in the full frame, by
+// Newton steps on the table interpolated bilinearly. gx and gy come in as
+// the starting guess, in cells. Returns non zero if the table is degenerate
+// there, which happens where it was clamped to the frame.
+int lens_undistort( const LensMap * lens , float sx , float sy , float * gx , float * gy )
+{
+  float x = *gx , y = *gy;
+  int i , ix , iy;
+  for( i = 0; i < 4; i++ )
+  {
+    ix = clampi( ( int ) x , 0 , lens->w - 2 );
+    iy = clampi( ( int ) y , 0 , lens->h - 2 );
+    float fx = x - ix , fy = y - iy;
+    const LensPoint * p = &lens->map[ix + iy * lens->w];
+    const LensPoint * q = p + lens->w;
+    float x00 = p[0].x , x10 = p[1].x , x01 = q[0].x , x11 = q[1].x;
+    float y00 = p[0].y , y10 = p[1].y , y01 = q[0].y , y11 = q[1].y;
+    float mx = ( x00 * ( 1 - fx ) + x10 * fx ) * ( 1 - fy ) + ( x01 * ( 1 - fx ) + x11 * fx ) * fy;
+    float my = ( y00 * ( 1 - fx ) + y10 * fx ) * ( 1 - fy ) + ( y01 * ( 1 - fx ) + y11 * fx ) * fy;
+    // Jacobian of the interpolated table
+    float xx = ( x10 - x00 ) * ( 1 - fy ) + ( x11 - x01 ) * fy;
+    float xy = ( x01 - x00 ) * ( 1 - fx ) + ( x11 - x10 ) * fx;
+    float yx = ( y10 - y00 ) * ( 1 - fy ) + ( y11 - y01 ) * fy;
+    float yy = ( y01 - y00 ) * ( 1 - fx ) + ( y11 - y10 ) * fx;
+    float det = xx * yy - xy * yx;
+    if( det < 1e-3f * LENS_ONE * LENS_ONE && det > -1e-3f * LENS_ONE * LENS_ONE ) return 1;
+    float ex = mx - sx * LENS_ONE;
+    float ey = my - sy * LENS_ONE;
+    x -= ( yy * ex - xy * ey ) / det;
+    y -= ( xx * ey - yx * ex ) / det;
+  }
+  *gx = x;
+  *gy = y;
+  return 0;
+}
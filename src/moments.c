@@ -0,0 +1,102 @@
+#include "include/moments.h"
+
+// Shape descriptors from the sums gathered while labeling. Integer only and
+// without data dependent branches outside of the square root, so describing
+// every candidate blob stays cheap.
+
+// atan(2^-i) in radians, 16 fractional bits
+static const int cordic_angles[16] =
+{
+  51472 , 30386 , 16055 , 8150 , 4091 , 2047 , 1024 , 512 ,
+  256 , 128 , 64 , 32 , 16 , 8 , 4 , 2
+};
+
+#define PI_16 205887 // pi with 16 fractional bits
+
+// Angle of (x, y) in radians with MOMENT_SHIFT fractional bits, by CORDIC
+// vectoring. Inputs should stay below 2^29, the gain takes x up to 1.65x.
+int fixed_atan2( int y , int x )
+{
+  int angle = 0;
+  int i , t;
+  if( ! x && ! y ) return 0;
+  // Small vectors lose everything to the shifts, scale them up
+  while( x < ( 1 << 27 ) && x > -( 1 << 27 ) && y < ( 1 << 27 ) && y > -( 1 << 27 ) )
+  {
+    x *= 2;
+    y *= 2;
+  }
+  // Rotate into the right half plane first
+  if( x < 0 )
+  {
+    angle = y >= 0 ? PI_16 : -PI_16;
+    x = -x;
+    y = -y;
+  }
+  for( i = 0; i < 16; i++ )
+  {
+    t = x;
+    if( y > 0 )
+    {
+      x += y >> i;
+      y -= t >> i;
+      angle += cordic_angles[i];
+    }else
+    {
+      x -= y >> i;
+      y += t >> i;
+      angle -= cordic_angles[i];
+    }
+  }
+  return angle >> ( 16 - MOMENT_SHIFT );
+}
+
+static long long isqrt( unsigned long long v )
+{
+  unsigned long long r = 0;
+  unsigned long long bit = 1ULL << 62;
+  while( bit > v ) bit >>= 2;
+  while( bit )
+  {
+    if( v >= r + bit )
+    {
+      v -= r + bit;
+      r = ( r >> 1 ) + bit;
+    }else
+      r >>= 1;
+    bit >>= 2;
+  }
+  return r;
+}
+
+// n^2 times the variance, straight from the sums
+static long long spread( long long n , long long sumab , long long suma , long long sumb )
+{
+  return n * sumab - suma * sumb;
+}
+
+void blob_moments( const Blob * b , Moments * m )
+{
+  long long n = b->count > 0 ? b->count : 1;
+  long long nn = n * n;
+  // A cell covers a unit square rather than a point, which adds 1/12 to the
+  // variances and keeps small blobs comparable to large ones.
+  long long cell = MOMENT_ONE / 12;
+  long long a = spread( n , b->sumxx , b->sumx , b->sumx ) * MOMENT_ONE / nn + cell;
+  long long c = spread( n , b->sumyy , b->sumy , b->sumy ) * MOMENT_ONE / nn + cell;
+  long long d = spread( n , b->sumxy , b->sumx , b->sumy ) * MOMENT_ONE / nn;
+  m->cx = ( ( long long ) b->sumx << MOMENT_SHIFT ) / n;
+  m->cy = ( ( long long ) b->sumy << MOMENT_SHIFT ) / n;
+  m->mu20 = a;
+  m->mu02 = c;
+  m->mu11 = d;
+  // Eigenvalues are ( a + c +- root ) / 2
+  long long root = isqrt( ( a - c ) * ( a - c ) + 4 * d * d );
+  m->eccentricity = ( root << MOMENT_SHIFT ) / ( a + c );
+  m->angle = fixed_atan2( 2 * d , a - c ) / 2;
+  // A solid w x h rectangle has l1 l2 = w^2 h^2 / 144, so its area is
+  // 12 sqrt( l1 l2 ) whichever way it is turned.
+  long long det = a * c - d * d;
+  long long area = 12 * isqrt( det > 0 ? det : 0 );
+  m->fill = ( n << ( 2 * MOMENT_SHIFT ) ) / ( area > 0 ? area : 1 );
+}
@@ -0,0 +1,260 @@
+#include <stdlib.h>
+#include <pthread.h>
+#include <string.h>
+#include "include/parlabel.h"
+
+// Strip parallel run labeling.
+//
+// The rows are cut into horizontal strips holding about the same number of
+// runs, and every strip is labeled on its own thread. A new label is the
+// index of the run that started it plus one, so strips never hand out the
+// same label and can share one parent table without locking. Each strip
+// sums up the stats of its own groups, then the groups that continue over a
+// strip boundary are joined, which folds their partial stats together.
+//
+// Unions keep the smaller label and labels grow in row-major order across
+// strips too, so the result matches label_runs and blobs_from_runs exactly.
+//
+// Given a filter, groups are judged as soon as they are complete: once a row
+// passes without continuing a group of the row above, nothing can join it
+// any more. Groups that break a maximum are dropped while still growing and
+// stop summing up stats. Groups touching a strip edge can only be decided
+// after the strips are joined.
+
+typedef struct
+{
+  RunMask * rm;
+  int connectivity;
+  int * parent;
+  Blob * blobs;
+  const BlobFilter * filter;    // NULL keeps every group
+  int y0 , y1;
+  unsigned rejects[RULE_COUNT]; // Groups this strip turned down
+} Strip;
+
+static struct
+{
+  pthread_mutex_t lock;
+  pthread_cond_t wake , done;
+  pthread_t * threads;
+  int workers;
+  int generation;
+  int phase;   // 0 labels and sums a strip, 1 writes the final labels
+  int active;  // Strips this phase
+  int pending; // Worker strips not yet done
+  int quit;
+  Strip strips[LABEL_THREADS];
+} pool;
+
+// Joins the runs of row y with the ones above, which must already be labeled.
+static void join_row( Strip * st , int y , int first )
+{
+  RunMask * rm = st->rm;
+  Run * runs = rm->runs;
+  int * parent = st->parent;
+  int reach = st->connectivity == 8 ? 1 : 0;
+  int p = y > first ? rm->rowstart[y-1] : 0;
+  int prevend = y > first ? rm->rowstart[y] : 0;
+  int i , q , l;
+  for( i = rm->rowstart[y]; i < rm->rowstart[y+1]; i++ )
+  {
+    Run * r = &runs[i];
+    while( p < prevend && runs[p].end + reach <= r->start ) p++;
+    l = 0;
+    for( q = p; q < prevend && runs[q].start < r->end + reach; q++ )
+      l = label_unite( parent , st->blobs , l , runs[q].label );
+    if( ! l )
+    {
+      l = i + 1;
+      parent[l] = l;
+      blob_start( &st->blobs[l-1] , r->start , y );
+    }else
+      parent[i+1] = 0; // Never handed out
+    r->label = l;
+    Blob * b = &st->blobs[l-1];
+    if( b->status == BLOB_DROPPED )
+    {
+      // Only the extent is still needed, to tell when it is complete
+      if( y > b->maxy ) b->maxy = y;
+      continue;
+    }
+    blob_add_run( b , r->start , r->end , y );
+    if( st->filter ) filter_hopeless( st->filter , b );
+  }
+}
+
+// Decides the groups of row y-1 that row y did not continue. Ones touching
+// the top of the strip may still continue into the strip above.
+static void close_row( Strip * st , int y )
+{
+  RunMask * rm = st->rm;
+  int i , l;
+  for( i = rm->rowstart[y-1]; i < rm->rowstart[y]; i++ )
+  {
+    l = label_unite( st->parent , st->blobs , 0 , rm->runs[i].label );
+    Blob * b = &st->blobs[l-1];
+    if( b->maxy >= y || ( b->miny == st->y0 && st->y0 > 0 ) ) continue;
+    if( b->status == BLOB_OPEN || b->status == BLOB_DROPPED )
+      filter_close( st->filter , b , st->rejects );
+  }
+}
+
+static void label_strip( Strip * st )
+{
+  int y;
+  for( y = st->y0; y < st->y1; y++ )
+  {
+    join_row( st , y , st->y0 );
+    if( st->filter && y > st->y0 ) close_row( st , y );
+  }
+}
+
+static void relabel_strip( Strip * st )
+{
+  RunMask * rm = st->rm;
+  int i;
+  for( i = rm->rowstart[st->y0]; i < rm->rowstart[st->y1]; i++ )
+    rm->runs[i].label = -st->parent[rm->runs[i].label];
+}
+
+static void run_strip( Strip * st , int phase )
+{
+  if( phase == 0 ) label_strip( st );
+  else relabel_strip( st );
+}
+
+static void * worker( void * arg )
+{
+  int index = ( int ) ( long ) arg;
+  int seen = 0;
+  pthread_mutex_lock( &pool.lock );
+  while( 1 )
+  {
+    while( pool.generation == seen && ! pool.quit )
+      pthread_cond_wait( &pool.wake , &pool.lock );
+    if( pool.quit ) break;
+    seen = pool.generation;
+    // Workers take strips 1 and up, the calling thread does strip 0
+    if( index < pool.active )
+    {
+      int phase = pool.phase;
+      pthread_mutex_unlock( &pool.lock );
+      run_strip( &pool.strips[index] , phase );
+      pthread_mutex_lock( &pool.lock );
+      if( --pool.pending == 0 ) pthread_cond_signal( &pool.done );
+    }
+  }
+  pthread_mutex_unlock( &pool.lock );
+  return NULL;
+}
+
+// Runs a phase over the strips and waits for all of them.
+static void run_phase( int strips , int phase )
+{
+  if( strips > 1 )
+  {
+    pthread_mutex_lock( &pool.lock );
+    pool.phase = phase;
+    pool.active = strips;
+    pool.pending = strips - 1;
+    pool.generation++;
+    pthread_cond_broadcast( &pool.wake );
+    pthread_mutex_unlock( &pool.lock );
+  }
+  run_strip( &pool.strips[0] , phase );
+  if( strips > 1 )
+  {
+    pthread_mutex_lock( &pool.lock );
+    while( pool.pending > 0 )
+      pthread_cond_wait( &pool.done , &pool.lock );
+    pthread_mutex_unlock( &pool.lock );
+  }
+}
+
+int parlabel_init( int threads )
+{
+  int i;
+  if( threads > LABEL_THREADS ) threads = LABEL_THREADS;
+  pthread_mutex_init( &pool.lock , NULL );
+  pthread_cond_init( &pool.wake , NULL );
+  pthread_cond_init( &pool.done , NULL );
+  pool.threads = ( pthread_t * ) malloc( sizeof( pthread_t ) * threads );
+  pool.workers = 0;
+  for( i = 1; i < threads; i++ )
+  {
+    if( pthread_create( &pool.threads[pool.workers] , NULL , worker , ( void * ) ( long ) i ) )
+      break;
+    pool.workers++;
+  }
+  return pool.workers != threads - 1;
+}
+
+void parlabel_quit()
+{
+  int i;
+  pthread_mutex_lock( &pool.lock );
+  pool.quit = 1;
+  pthread_cond_broadcast( &pool.wake );
+  pthread_mutex_unlock( &pool.lock );
+  for( i = 0; i < pool.workers; i++ )
+    pthread_join( pool.threads[i] , NULL );
+  free( pool.threads );
+  pool.threads = NULL;
+  pool.workers = 0;
+}
+
+// Labels the runs and fills blobs with the stats of every group, returning
+// the group count. parent and blobs need one entry per run plus one. With a
+// filter only the groups passing it are kept, the runs of the others get
+// label 0, and the rejects are added to its counters.
+int parlabel_runs( RunMask * rm , int connectivity , int threads , BlobFilter * filter , int * parent , Blob * blobs )
+{
+  int strips = threads;
+  int s , y , l , i , count;
+  if( strips > pool.workers + 1 ) strips = pool.workers + 1;
+  if( strips > rm->count / MIN_STRIP_RUNS ) strips = rm->count / MIN_STRIP_RUNS;
+  if( strips > rm->h ) strips = rm->h;
+  if( strips < 1 ) strips = 1;
+  // Cut where the running run count passes each share
+  for( s = 0 , y = 0; s < strips; s++ )
+  {
+    Strip * st = &pool.strips[s];
+    *st = ( Strip ) { .rm = rm , .connectivity = connectivity , .parent = parent , .blobs = blobs ,
+                      .filter = filter , .y0 = y , .y1 = rm->h };
+    if( s == strips - 1 ) break;
+    int share = ( long ) rm->count * ( s + 1 ) / strips;
+    while( y < rm->h - ( strips - s - 1 ) && rm->rowstart[y+1] <= share ) y++;
+    if( y == st->y0 ) y++;
+    st->y1 = y;
+  }
+  run_phase( strips , 0 );
+  // Join the groups running over each boundary
+  for( s = 1; s < strips; s++ )
+  {
+    Strip * st = &pool.strips[s];
+    int reach = connectivity == 8 ? 1 : 0;
+    int p = rm->rowstart[st->y0 - 1];
+    int prevend = rm->rowstart[st->y0];
+    int i , q;
+    for( i = rm->rowstart[st->y0]; i < rm->rowstart[st->y0 + 1]; i++ )
+    {
+      Run * r = &rm->runs[i];
+      while( p < prevend && rm->runs[p].end + reach <= r->start ) p++;
+      for( q = p; q < prevend && rm->runs[q].start < r->end + reach; q++ )
+        label_unite( parent , blobs , rm->runs[q].label , r->label );
+    }
+  }
+  if( filter )
+  {
+    // Whatever the strips left open is complete now
+    for( l = 1; l <= rm->count; l++ )
+      if( parent[l] == l && ( blobs[l-1].status == BLOB_OPEN || blobs[l-1].status == BLOB_DROPPED ) )
+        filter_close( filter , &blobs[l-1] , filter->rejects );
+    for( s = 0; s < strips; s++ )
+      for( i = 0; i < RULE_COUNT; i++ )
+        filter->rejects[i] += pool.strips[s].rejects[i];
+  }
+  count = label_resolve( parent , blobs , rm->count + 1 );
+  run_phase( strips , 1 );
+  return count;
+}
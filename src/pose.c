@@ -0,0 +1,233 @@
+#include <math.h>
+#include <string.h>
+#include "include/pose.h"
+
+// Pose from the homography of the board, and intrinsics from several of
+// them, both after Zhang's "A Flexible New Technique for Camera
+// Calibration". The homography is taken as K [r1 r2 t] of the board plane,
+// so K^-1 H gives two columns of the rotation and the translation up to
+// scale. Nothing here allocates.
+
+static void normalize( float * v )
+{
+  float n = sqrtf( v[0] * v[0] + v[1] * v[1] + v[2] * v[2] );
+  v[0] /= n;
+  v[1] /= n;
+  v[2] /= n;
+}
+
+// h maps the w by hgt board, from its top left corner, onto undistorted
+// pixels. Returns non zero if the intrinsics or h are unusable.
+int pose_from_homography( const LensCalibration * cal , const Homography * h ,
+                          float w , float hgt , Pose * p )
+{
+  const float * m = h->m;
+  float c[3][3] , a[3] , b[3] , s , la , lb;
+  int i;
+  if( cal->fx <= 0 || cal->fy <= 0 ) return 1;
+  // Columns of K^-1 H, with the third moved to the board centre
+  for( i = 0; i < 3; i++ )
+  {
+    c[0][i] = m[i];
+    c[1][i] = m[3+i];
+    c[2][i] = m[6+i];
+  }
+  for( i = 0; i < 3; i++ )
+    c[i][2] += c[i][0] * w / 2 + c[i][1] * hgt / 2;
+  for( i = 0; i < 3; i++ )
+  {
+    c[0][i] = ( c[0][i] - cal->cx * c[2][i] ) / cal->fx;
+    c[1][i] = ( c[1][i] - cal->cy * c[2][i] ) / cal->fy;
+  }
+  la = sqrtf( c[0][0] * c[0][0] + c[1][0] * c[1][0] + c[2][0] * c[2][0] );
+  lb = sqrtf( c[0][1] * c[0][1] + c[1][1] * c[1][1] + c[2][1] * c[2][1] );
+  if( la == 0 || lb == 0 ) return 1;
+  s = 2 / ( la + lb );
+  // The board is in front of the camera
+  if( c[2][2] < 0 ) s = -s;
+  for( i = 0; i < 3; i++ )
+  {
+    a[i] = c[i][0] * s;
+    b[i] = c[i][1] * s;
+    p->t[i] = c[i][2] * s;
+  }
+  // Noise leaves the two columns a little off perpendicular and of unequal
+  // length. Of unit vectors the sum and difference are perpendicular, so
+  // split the difference evenly between them through those.
+  normalize( a );
+  normalize( b );
+  float u[3] = { a[0] + b[0] , a[1] + b[1] , a[2] + b[2] };
+  float v[3] = { a[0] - b[0] , a[1] - b[1] , a[2] - b[2] };
+  normalize( u );
+  normalize( v );
+  for( i = 0; i < 3; i++ )
+  {
+    a[i] = ( u[i] + v[i] ) * ( float ) M_SQRT1_2;
+    b[i] = ( u[i] - v[i] ) * ( float ) M_SQRT1_2;
+  }
+  for( i = 0; i < 3; i++ )
+  {
+    p->r[i*3] = a[i];
+    p->r[i*3+1] = b[i];
+  }
+  p->r[2] = a[1] * b[2] - a[2] * b[1];
+  p->r[5] = a[2] * b[0] - a[0] * b[2];
+  p->r[8] = a[0] * b[1] - a[1] * b[0];
+  return 0;
+}
+
+// The pose as six numbers that can be filtered, the translation followed by
+// the rotation as axis times angle.
+void pose_to_vector( const Pose * p , float * v )
+{
+  const float * r = p->r;
+  float c = ( r[0] + r[4] + r[8] - 1 ) / 2;
+  float angle = acosf( c > 1 ? 1 : ( c < -1 ? -1 : c ) );
+  float s = sinf( angle );
+  float k = s > 1e-6f ? angle / ( 2 * s ) : 0.5f;
+  v[0] = p->t[0];
+  v[1] = p->t[1];
+  v[2] = p->t[2];
+  v[3] = ( r[7] - r[5] ) * k;
+  v[4] = ( r[2] - r[6] ) * k;
+  v[5] = ( r[3] - r[1] ) * k;
+}
+
+void pose_from_vector( const float * v , Pose * p )
+{
+  float angle = sqrtf( v[3] * v[3] + v[4] * v[4] + v[5] * v[5] );
+  float k[3] = { 0 , 0 , 0 };
+  float c = cosf( angle ) , s = sinf( angle );
+  int i , j;
+  if( angle > 1e-6f )
+    for( i = 0; i < 3; i++ ) k[i] = v[3+i] / angle;
+  for( i = 0; i < 3; i++ )
+  {
+    p->t[i] = v[i];
+    for( j = 0; j < 3; j++ )
+      p->r[i*3+j] = ( i == j ? c : 0 ) + ( 1 - c ) * k[i] * k[j];
+  }
+  p->r[1] -= s * k[2];
+  p->r[2] += s * k[1];
+  p->r[3] += s * k[2];
+  p->r[5] -= s * k[0];
+  p->r[6] -= s * k[1];
+  p->r[7] += s * k[0];
+}
+
+void calib_reset( Calibration * c )
+{
+  c->views = 0;
+}
+
+// Returns non zero once there's no room for more views.
+int calib_add( Calibration * c , const Homography * h )
+{
+  if( c->views == CALIB_MAX_VIEWS ) return 1;
+  c->h[c->views++] = *h;
+  return 0;
+}
+
+// Eigenvector of the smallest eigenvalue of the symmetric n by n matrix a,
+// by Jacobi rotations. a is destroyed.
+#define N 5
+static void smallest_eigenvector( double a[N][N] , double * out )
+{
+  double v[N][N];
+  int i , j , k , p , q , sweep;
+  for( i = 0; i < N; i++ )
+    for( j = 0; j < N; j++ )
+      v[i][j] = i == j;
+  for( sweep = 0; sweep < 50; sweep++ )
+  {
+    double off = 0;
+    for( p = 0; p < N; p++ )
+      for( q = p + 1; q < N; q++ )
+        off += a[p][q] * a[p][q];
+    if( off < 1e-30 ) break;
+    for( p = 0; p < N; p++ )
+      for( q = p + 1; q < N; q++ )
+      {
+        if( a[p][q] == 0 ) continue;
+        double theta = ( a[q][q] - a[p][p] ) / ( 2 * a[p][q] );
+        double t = ( theta >= 0 ? 1 : -1 ) / ( fabs( theta ) + sqrt( theta * theta + 1 ) );
+        double c = 1 / sqrt( t * t + 1 ) , s = t * c;
+        for( k = 0; k < N; k++ )
+        {
+          double akp = a[k][p] , akq = a[k][q];
+          a[k][p] = c * akp - s * akq;
+          a[k][q] = s * akp + c * akq;
+        }
+        for( k = 0; k < N; k++ )
+        {
+          double apk = a[p][k] , aqk = a[q][k];
+          a[p][k] = c * apk - s * aqk;
+          a[q][k] = s * apk + c * aqk;
+        }
+        for( k = 0; k < N; k++ )
+        {
+          double vkp = v[k][p] , vkq = v[k][q];
+          v[k][p] = c * vkp - s * vkq;
+          v[k][q] = s * vkp + c * vkq;
+        }
+      }
+  }
+  for( i = 1 , j = 0; i < N; i++ )
+    if( a[i][i] < a[j][j] ) j = i;
+  for( i = 0; i < N; i++ ) out[i] = v[i][j];
+}
+
+// Zhang's constraint row for columns i and j of h, without the skew term.
+// The unknowns are B11, B22, B13, B23 and B33 of K^-T K^-1.
+static void constraint( const double h[3][3] , int i , int j , double * row )
+{
+  row[0] = h[0][i] * h[0][j];
+  row[1] = h[1][i] * h[1][j];
+  row[2] = h[2][i] * h[0][j] + h[0][i] * h[2][j];
+  row[3] = h[2][i] * h[1][j] + h[1][i] * h[2][j];
+  row[4] = h[2][i] * h[2][j];
+}
+
+// Solves the focal lengths and principal point from the collected views,
+// assuming square-on pixel axes. scale should be about the image width,
+// pixels are divided by it to keep the numbers in range. Distortion in cal
+// is left alone. Returns non zero with too few or too similar views.
+int calib_solve( const Calibration * c , float scale , LensCalibration * cal )
+{
+  double ata[N][N] , b[N] , h[3][3] , r[2][N] , n;
+  int v , i , j , k;
+  if( c->views < CALIB_MIN_VIEWS ) return 1;
+  memset( ata , 0 , sizeof( ata ) );
+  for( v = 0; v < c->views; v++ )
+  {
+    for( i = 0; i < 3; i++ )
+      for( j = 0; j < 3; j++ )
+        h[i][j] = c->h[v].m[i*3+j] / ( i < 2 ? scale : 1 );
+    for( n = 0 , i = 0; i < 9; i++ ) n += h[i/3][i%3] * h[i/3][i%3];
+    n = sqrt( n );
+    for( i = 0; i < 9; i++ ) h[i/3][i%3] /= n;
+    double a[N] , d[N];
+    constraint( h , 0 , 1 , r[0] );
+    constraint( h , 0 , 0 , a );
+    constraint( h , 1 , 1 , d );
+    for( i = 0; i < N; i++ ) r[1][i] = a[i] - d[i];
+    for( k = 0; k < 2; k++ )
+      for( i = 0; i < N; i++ )
+        for( j = 0; j < N; j++ )
+          ata[i][j] += r[k][i] * r[k][j];
+  }
+  smallest_eigenvector( ata , b );
+  // B is only known up to sign, B11 has to be positive
+  if( b[0] < 0 )
+    for( i = 0; i < N; i++ ) b[i] = -b[i];
+  if( b[0] <= 0 || b[1] <= 0 ) return 1;
+  double cy = -b[3] / b[1];
+  double cx = -b[2] / b[0];
+  double lambda = b[4] - ( b[2] * b[2] / b[0] + b[3] * b[3] / b[1] );
+  if( lambda <= 0 ) return 1;
+  cal->fx = sqrt( lambda / b[0] ) * scale;
+  cal->fy = sqrt( lambda / b[1] ) * scale;
+  cal->cx = cx * scale;
+  cal->cy = cy * scale;
+  return 0;
+}
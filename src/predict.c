@@ -0,0 +1,55 @@
+#include <string.h>
+#include "include/predict.h"
+
+void ab_init( AlphaBeta * f , int n , float alpha , float beta , float coast )
+{
+  memset( f , 0 , sizeof( AlphaBeta ) );
+  f->n = n;
+  f->alpha = alpha;
+  f->beta = beta;
+  f->coast = coast;
+}
+
+// Folds in a measurement taken at time t. After a gap longer than the
+// coasting time the old state says nothing and is dropped.
+void ab_update( AlphaBeta * f , const float * z , double t )
+{
+  int i;
+  float dt = t - f->t , r;
+  if( ! f->valid || dt > f->coast )
+  {
+    for( i = 0; i < f->n; i++ )
+    {
+      f->x[i] = z[i];
+      f->v[i] = 0;
+    }
+    f->t = t;
+    f->valid = 1;
+    return;
+  }
+  for( i = 0; i < f->n; i++ )
+  {
+    f->x[i] += f->v[i] * dt;
+    r = z[i] - f->x[i];
+    f->x[i] += f->alpha * r;
+    // Without time in between there's no rate to learn
+    if( dt > 0 ) f->v[i] += f->beta * r / dt;
+  }
+  if( dt > 0 ) f->t = t;
+}
+
+// Extrapolates the state to time t into out, without changing it. Returns
+// non zero, and forgets the state, once it has coasted for too long.
+int ab_predict( AlphaBeta * f , double t , float * out )
+{
+  int i;
+  float dt = t - f->t;
+  if( ! f->valid ) return 1;
+  if( dt > f->coast )
+  {
+    f->valid = 0;
+    return 1;
+  }
+  for( i = 0; i < f->n; i++ ) out[i] = f->x[i] + f->v[i] * dt;
+  return 0;
+}
@@ -0,0 +1,33 @@
+#include "include/refine.h"
+
+// Centroid of the red excess over the pixels in [x0, x1) x [y0, y1) of a
+// packed RGB frame w pixels wide, the same excess apply_contrast thresholds.
+// Only what a pixel has above base counts, so the background around a
+// marker doesn't pull the centroid towards the middle of the window. Pixel
+// centres are at whole coordinates. Returns non zero if no pixel counted,
+// leaving cx and cy alone, otherwise they are in REFINE_ONE units.
+int refine_centroid( const byte * rgb , int w , int x0 , int y0 , int x1 , int y1 ,
+                     int base , int * cx , int * cy )
+{
+  long long sum = 0 , sumx = 0 , sumy = 0;
+  int x , y , rowsum , rowx , weight;
+  for( y = y0; y < y1; y++ )
+  {
+    const byte * p = rgb + ( y * w + x0 ) * 3;
+    rowsum = rowx = 0;
+    for( x = x0; x < x1; x++ , p += 3 )
+    {
+      weight = p[0] - ( p[1] + p[2] ) / 2 - base;
+      if( weight <= 0 ) continue;
+      rowsum += weight;
+      rowx += weight * ( x - x0 );
+    }
+    sum += rowsum;
+    sumx += rowx;
+    sumy += ( long long ) rowsum * y;
+  }
+  if( ! sum ) return 1;
+  *cx = ( x0 << REFINE_SHIFT ) + ( int ) ( ( sumx << REFINE_SHIFT ) / sum );
+  *cy = ( int ) ( ( sumy << REFINE_SHIFT ) / sum );
+  return 0;
+}
@@ -0,0 +1,199 @@
+#include <string.h>
+#include "include/scale.h"
+#if defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+#include <arm_neon.h>
+#define SCALE_NEON
+#elif defined( __SSE2__ )
+#include <emmintrin.h>
+#define SCALE_SSE2
+#endif
+
+// Scales packed 3 or 4 byte pixels.
+//
+// Source positions step in 16.16 fixed point from pixel centre to pixel
+// centre. Where every destination column comes from only depends on x, so
+// it is worked out once per call into a table. Bilinear filtering first
+// filters the two source rows a destination row falls between across,
+// then mixes those two down. Consecutive destination rows mostly share
+// their source rows, so a filtered row is kept until it is passed. The
+// mix down is the same weight for a whole row and gets a vector kernel.
+// Only the part of the destination that is on it is ever touched.
+
+typedef unsigned int u32;
+
+// Scratch for a clipped width of up to maxw pixels.
+size_t scale_size( int maxw )
+{
+  return maxw * ( 2 * sizeof( int ) + 2 * 4 ) + 3 * ARENA_ALIGN;
+}
+
+// Source position of the centre of destination pixel i of n, for a source
+// size of s, in 16.16.
+static int centre( int i , int n , int s )
+{
+  return ( int ) ( ( ( long long ) ( 2 * i + 1 ) * s << 16 ) / ( 2 * n ) ) - 0x8000;
+}
+
+// Filters the n destination pixels of a row across from a source row.
+static void filter_row( const unsigned char * row , const int * offset , const int * weight , int n , int bpp ,
+                        unsigned char * out )
+{
+  int i , c , t;
+  if( bpp == 4 )
+  {
+    u32 * o = ( u32 * ) out;
+    for( i = 0; i < n; i++ )
+    {
+      u32 a = *( const u32 * ) ( row + offset[i] ) , b = *( const u32 * ) ( row + offset[i] + 4 );
+      t = weight[i];
+      // Two bytes at a time, each product fits its 16 bit lane
+      u32 rb = ( ( a & 0x00FF00FF ) * ( 256 - t ) + ( b & 0x00FF00FF ) * t ) >> 8;
+      u32 ga = ( ( a >> 8 & 0x00FF00FF ) * ( 256 - t ) + ( b >> 8 & 0x00FF00FF ) * t ) >> 8;
+      o[i] = ( rb & 0x00FF00FF ) | ( ( ga & 0x00FF00FF ) << 8 );
+    }
+    return;
+  }
+  for( i = 0; i < n; i++ , out += bpp )
+  {
+    const unsigned char * p = row + offset[i];
+    t = weight[i];
+    for( c = 0; c < bpp; c++ ) out[c] = ( p[c] * ( 256 - t ) + p[c+bpp] * t ) >> 8;
+  }
+}
+
+// Same for a source one pixel wide, which has nothing to filter across.
+static void copy_row( const unsigned char * row , const int * offset , int n , int bpp , unsigned char * out )
+{
+  int i;
+  for( i = 0; i < n; i++ , out += bpp ) memcpy( out , row + offset[i] , bpp );
+}
+
+// out = a + ( b - a ) * t / 256 over n bytes, t in 0 to 255.
+static void mix_rows( const unsigned char * a , const unsigned char * b , int t , int n , unsigned char * out )
+{
+  int i = 0;
+  if( ! t )
+  {
+    memcpy( out , a , n );
+    return;
+  }
+#if defined( SCALE_NEON )
+  uint8x8_t ta = vdup_n_u8( 256 - t ) , tb = vdup_n_u8( t );
+  for( ; i + 16 <= n; i += 16 )
+  {
+    uint8x16_t va = vld1q_u8( a + i ) , vb = vld1q_u8( b + i );
+    uint16x8_t lo = vmlal_u8( vmull_u8( vget_low_u8( va ) , ta ) , vget_low_u8( vb ) , tb );
+    uint16x8_t hi = vmlal_u8( vmull_u8( vget_high_u8( va ) , ta ) , vget_high_u8( vb ) , tb );
+    vst1q_u8( out + i , vcombine_u8( vshrn_n_u16( lo , 8 ) , vshrn_n_u16( hi , 8 ) ) );
+  }
+#elif defined( SCALE_SSE2 )
+  __m128i zero = _mm_setzero_si128();
+  __m128i ta = _mm_set1_epi16( 256 - t ) , tb = _mm_set1_epi16( t );
+  for( ; i + 16 <= n; i += 16 )
+  {
+    __m128i va = _mm_loadu_si128( ( const __m128i * ) ( a + i ) );
+    __m128i vb = _mm_loadu_si128( ( const __m128i * ) ( b + i ) );
+    __m128i lo = _mm_add_epi16( _mm_mullo_epi16( _mm_unpacklo_epi8( va , zero ) , ta ) ,
+                                _mm_mullo_epi16( _mm_unpacklo_epi8( vb , zero ) , tb ) );
+    __m128i hi = _mm_add_epi16( _mm_mullo_epi16( _mm_unpackhi_epi8( va , zero ) , ta ) ,
+                                _mm_mullo_epi16( _mm_unpackhi_epi8( vb , zero ) , tb ) );
+    _mm_storeu_si128( ( __m128i * ) ( out + i ) ,
+                      _mm_packus_epi16( _mm_srli_epi16( lo , 8 ) , _mm_srli_epi16( hi , 8 ) ) );
+  }
+#endif
+  for( ; i < n; i++ ) out[i] = ( a[i] * ( 256 - t ) + b[i] * t ) >> 8;
+}
+
+// Scales the sw by sh image src to w by h at x, y on the dw by dh image
+// dst, both bpp bytes a pixel. Pitches are in bytes. Returns non zero if
+// the arena is out of room, nothing is drawn then.
+int scale_image( const unsigned char * src , int sw , int sh , int spitch ,
+                 unsigned char * dst , int dw , int dh , int dpitch , int bpp ,
+                 int x , int y , int w , int h , int flags , Arena * a )
+{
+  int x0 = x < 0 ? 0 : x , y0 = y < 0 ? 0 : y;
+  int x1 = x + w > dw ? dw : x + w , y1 = y + h > dh ? dh : y + h;
+  int n = x1 - x0 , i , j , sx , sy , row0 = -1 , row1 = -1 , t;
+  size_t mark;
+  if( n <= 0 || y1 <= y0 || sw <= 0 || sh <= 0 ) return 0;
+  mark = arena_mark( a );
+  int * offset = ( int * ) arena_alloc( a , n * sizeof( int ) );
+  int * weight = ( int * ) arena_alloc( a , n * sizeof( int ) );
+  unsigned char * above = ( unsigned char * ) arena_alloc( a , n * 4 );
+  unsigned char * below = ( unsigned char * ) arena_alloc( a , n * 4 );
+  if( ! offset || ! weight || ! above || ! below )
+  {
+    arena_release( a , mark );
+    return 1;
+  }
+  dst += y0 * dpitch + x0 * bpp;
+  if( !( flags & SCALE_BILINEAR ) )
+  {
+    for( i = 0; i < n; i++ )
+    {
+      sx = ( centre( x0 - x + i , w , sw ) + 0x8000 ) >> 16;
+      offset[i] = ( sx < 0 ? 0 : ( sx >= sw ? sw - 1 : sx ) ) * bpp;
+    }
+    for( j = y0; j < y1; j++ , dst += dpitch )
+    {
+      sy = ( centre( j - y , h , sh ) + 0x8000 ) >> 16;
+      const unsigned char * row = src + ( sy < 0 ? 0 : ( sy >= sh ? sh - 1 : sy ) ) * spitch;
+      if( bpp == 4 )
+        for( i = 0; i < n; i++ ) ( ( u32 * ) dst )[i] = *( const u32 * ) ( row + offset[i] );
+      else
+        for( i = 0; i < n; i++ )
+        {
+          dst[i*3] = row[offset[i]];
+          dst[i*3+1] = row[offset[i]+1];
+          dst[i*3+2] = row[offset[i]+2];
+        }
+    }
+    arena_release( a , mark );
+    return 0;
+  }
+  // Edges clamp, the pixel past the last one is the last one again
+  for( i = 0; i < n; i++ )
+  {
+    sx = centre( x0 - x + i , w , sw );
+    if( sx < 0 ) sx = 0;
+    if( sx > ( sw - 1 ) << 16 ) sx = ( sw - 1 ) << 16;
+    offset[i] = ( sx >> 16 ) * bpp;
+    weight[i] = ( sx & 0xFFFF ) >> 8;
+    if( ( sx >> 16 ) == sw - 1 && sw > 1 )
+    {
+      offset[i] -= bpp;
+      weight[i] = 256;
+    }
+  }
+  for( j = y0; j < y1; j++ , dst += dpitch )
+  {
+    sy = centre( j - y , h , sh );
+    if( sy < 0 ) sy = 0;
+    if( sy > ( sh - 1 ) << 16 ) sy = ( sh - 1 ) << 16;
+    int r = sy >> 16 , r1 = r + 1 < sh ? r + 1 : r;
+    t = ( sy & 0xFFFF ) >> 8;
+    if( r != row0 )
+    {
+      if( r == row1 )
+      {
+        unsigned char * s = above;
+        above = below;
+        below = s;
+      }else if( sw > 1 )
+        filter_row( src + r * spitch , offset , weight , n , bpp , above );
+      else
+        copy_row( src + r * spitch , offset , n , bpp , above );
+      row0 = r;
+      row1 = -1;
+    }
+    if( r1 != row1 )
+    {
+      if( sw > 1 ) filter_row( src + r1 * spitch , offset , weight , n , bpp , below );
+      else copy_row( src + r1 * spitch , offset , n , bpp , below );
+      row1 = r1;
+    }
+    mix_rows( above , below , t , n * bpp , dst );
+  }
+  arena_release( a , mark );
+  return 0;
+}
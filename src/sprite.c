@@ -0,0 +1,73 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "include/sprite.h"
+#include "include/scale.h"
+
+// The display object is drawn at whatever size the board has on screen,
+// which barely changes from one frame to the next. Scales are rounded to
+// SPRITE_STEPS a doubling, about 9% apart, and each one is scaled once
+// into a slot, already in the layout it is drawn in. Drawing it is then
+// just a blend. Slots are made up front at the biggest size they take, so
+// a new scale never allocates. Copies are filtered, they are made rarely
+// enough.
+
+int sprite_init( SpriteCache * c , const unsigned char * image , int w , int h , int pitch , int maxw , int maxh )
+{
+  int i;
+  memset( c , 0 , sizeof( SpriteCache ) );
+  c->image = image;
+  c->imagew = w;
+  c->imageh = h;
+  c->imagepitch = pitch;
+  c->maxw = maxw;
+  c->maxh = maxh;
+  c->pitch = maxw * 4;
+  for( i = 0; i < SPRITE_SLOTS; i++ )
+    if( !( c->slots[i].pixels = ( unsigned char * ) malloc( c->pitch * maxh ) ) ) return 1;
+  return 0;
+}
+
+void sprite_free( SpriteCache * c )
+{
+  int i;
+  for( i = 0; i < SPRITE_SLOTS; i++ ) free( c->slots[i].pixels );
+  memset( c , 0 , sizeof( SpriteCache ) );
+}
+
+// The image at about scale, c->pitch bytes a row, its size in w and h.
+// Returns NULL if that is bigger than a slot, then it has to be scaled some
+// other way. a is scratch for filling a slot, see scale_size.
+const unsigned char * sprite_get( SpriteCache * c , float scale , int * w , int * h , Arena * a )
+{
+  SpriteSlot * s , * lru;
+  int i , step;
+  if( scale <= 0 ) return NULL;
+  step = floorf( log2f( scale ) * SPRITE_STEPS + 0.5f );
+  scale = exp2f( ( float ) step / SPRITE_STEPS );
+  *w = c->imagew * scale + 0.5f;
+  *h = c->imageh * scale + 0.5f;
+  if( *w < 1 || *h < 1 || *w > c->maxw || *h > c->maxh ) return NULL;
+  c->clock++;
+  lru = &c->slots[0];
+  for( i = 0; i < SPRITE_SLOTS; i++ )
+  {
+    s = &c->slots[i];
+    if( s->used && s->step == step )
+    {
+      s->used = c->clock;
+      c->hits++;
+      return s->pixels;
+    }
+    if( s->used < lru->used ) lru = s;
+  }
+  c->misses++;
+  if( scale_image( c->image , c->imagew , c->imageh , c->imagepitch , lru->pixels , c->maxw , c->maxh , c->pitch , 4 ,
+                   0 , 0 , *w , *h , SCALE_BILINEAR , a ) )
+    return NULL;
+  lru->step = step;
+  lru->w = *w;
+  lru->h = *h;
+  lru->used = c->clock;
+  return lru->pixels;
+}
@@ -0,0 +1,170 @@
+#include "include/squares.h"
+
+static void int_fields( SquareTable * t , int ** fields[SQUARE_INT_FIELDS] )
+{
+  int ** all[SQUARE_INT_FIELDS] =
+  {
+    &t->x , &t->y , &t->w , &t->h , &t->size , &t->area , &t->cx , &t->cy ,
+    &t->fx , &t->fy , &t->angle , &t->eccentricity , &t->fill
+  };
+  int i;
+  for( i = 0; i < SQUARE_INT_FIELDS; i++ ) fields[i] = all[i];
+}
+
+static size_t aligned( size_t bytes )
+{
+  return ( bytes + ARENA_ALIGN - 1 ) & ~( size_t ) ( ARENA_ALIGN - 1 );
+}
+
+// Arena bytes squares_init takes for capacity squares.
+size_t squares_size( int capacity )
+{
+  return SQUARE_INT_FIELDS * aligned( capacity * sizeof( int ) ) + aligned( capacity * sizeof( Contour * ) );
+}
+
+// Returns non zero if the arena can't hold capacity squares.
+int squares_init( SquareTable * t , Arena * a , int capacity )
+{
+  int ** fields[SQUARE_INT_FIELDS];
+  int i;
+  int_fields( t , fields );
+  t->count = 0;
+  t->capacity = capacity;
+  for( i = 0; i < SQUARE_INT_FIELDS; i++ )
+    if( ! ( *fields[i] = ( int * ) arena_alloc( a , capacity * sizeof( int ) ) ) ) return 1;
+  t->outline = ( Contour ** ) arena_alloc( a , capacity * sizeof( Contour * ) );
+  return ! t->outline;
+}
+
+void squares_swap( SquareTable * t , int i , int j )
+{
+  int ** fields[SQUARE_INT_FIELDS];
+  int f , v;
+  int_fields( t , fields );
+  for( f = 0; f < SQUARE_INT_FIELDS; f++ )
+  {
+    int * a = *fields[f];
+    v = a[i];
+    a[i] = a[j];
+    a[j] = v;
+  }
+  Contour * c = t->outline[i];
+  t->outline[i] = t->outline[j];
+  t->outline[j] = c;
+}
+
+// Keeps the squares whose keep entry is set, in order, one field at a time.
+// Returns the new count.
+int squares_compact( SquareTable * t , const unsigned char * keep )
+{
+  int ** fields[SQUARE_INT_FIELDS];
+  int f , i , kept = 0;
+  int_fields( t , fields );
+  for( f = 0; f < SQUARE_INT_FIELDS; f++ )
+  {
+    int * a = *fields[f];
+    // Writing every entry and only advancing on keep avoids a branch
+    for( i = 0 , kept = 0; i < t->count; i++ )
+    {
+      a[kept] = a[i];
+      kept += keep[i] != 0;
+    }
+  }
+  for( i = 0 , kept = 0; i < t->count; i++ )
+  {
+    t->outline[kept] = t->outline[i];
+    kept += keep[i] != 0;
+  }
+  t->count = kept;
+  return kept;
+}
+
+// Biggest first.
+void score_size( const SquareTable * t , int * scores )
+{
+  int i;
+  for( i = 0; i < t->count; i++ ) scores[i] = t->size[i];
+}
+
+// Closest to the mean size first, markers of one constellation are about
+// the same size.
+void score_mean_size( const SquareTable * t , int * scores )
+{
+  int i , d;
+  long long sum = 0;
+  if( ! t->count ) return;
+  for( i = 0; i < t->count; i++ ) sum += t->size[i];
+  int mean = sum / t->count;
+  for( i = 0; i < t->count; i++ )
+  {
+    d = t->size[i] - mean;
+    scores[i] = -( d < 0 ? -d : d );
+  }
+}
+
+// Higher score first, ties to the lower index, so picks are stable.
+#define better( a , b ) ( scores[a] > scores[b] || ( scores[a] == scores[b] && ( a ) < ( b ) ) )
+
+// Moves the k best of idx[0, n) to the front in no particular order,
+// expected linear time.
+static void quickselect( const int * scores , int * idx , int n , int k )
+{
+  int lo = 0 , hi = n - 1;
+  int i , j , p , t;
+  while( lo < hi )
+  {
+    // Median of three as pivot
+    int mid = lo + ( hi - lo ) / 2;
+    if( better( idx[mid] , idx[lo] ) ) { t = idx[mid]; idx[mid] = idx[lo]; idx[lo] = t; }
+    if( better( idx[hi] , idx[lo] ) ) { t = idx[hi]; idx[hi] = idx[lo]; idx[lo] = t; }
+    if( better( idx[hi] , idx[mid] ) ) { t = idx[hi]; idx[hi] = idx[mid]; idx[mid] = t; }
+    p = idx[mid];
+    i = lo;
+    j = hi;
+    while( i <= j )
+    {
+      while( better( idx[i] , p ) ) i++;
+      while( better( p , idx[j] ) ) j--;
+      if( i <= j )
+      {
+        t = idx[i];
+        idx[i++] = idx[j];
+        idx[j--] = t;
+      }
+    }
+    if( k - 1 <= j ) hi = j;
+    else if( k - 1 >= i ) lo = i;
+    else break;
+  }
+}
+
+// Picks the k best squares under score without touching the table, writing
+// their indices best first to out. Scratch comes from a and is given back.
+// Returns how many were picked, fewer than k if there aren't enough.
+int squares_top( const SquareTable * t , SquareScore score , int k , int * out , Arena * a )
+{
+  size_t mark = arena_mark( a );
+  int n = t->count;
+  int i , j , v;
+  if( k > n ) k = n;
+  if( k <= 0 ) return 0;
+  int * scores = ( int * ) arena_alloc( a , n * sizeof( int ) );
+  int * idx = ( int * ) arena_alloc( a , n * sizeof( int ) );
+  if( ! idx )
+  {
+    arena_release( a , mark );
+    return 0;
+  }
+  score( t , scores );
+  for( i = 0; i < n; i++ ) idx[i] = i;
+  quickselect( scores , idx , n , k );
+  // k is small, insertion sort the picks
+  for( i = 0; i < k; i++ )
+  {
+    v = idx[i];
+    for( j = i; j > 0 && better( v , out[j-1] ); j-- ) out[j] = out[j-1];
+    out[j] = v;
+  }
+  arena_release( a , mark );
+  return k;
+}
@@ -0,0 +1,180 @@
+#include <string.h>
+#include "include/track.h"
+#include "include/refine.h"
+
+// Follows the squares from frame to frame, so that the same marker keeps
+// the same id.
+//
+// Every track predicts where its square is now. Squares near enough to the
+// prediction, and of about the same size, are candidates for it, and only
+// the few nearest are kept, so with MAX_TRACKS tracks there are never more
+// than MAX_TRACKS * CANDIDATES pairs to assign however many squares there
+// are. The pairs are assigned nearest first, each track and square at most
+// once. Squares left over start new tracks, which only count once they have
+// been seen a few frames in a row, and tracks are dropped after missing a
+// few, so a blob flickering for a frame neither makes nor breaks a track.
+
+// Nearest squares kept per track
+#define CANDIDATES 4
+// Frames in a row before a track counts, and misses before it goes
+#define TRACK_CONFIRM 3
+#define TRACK_MISSES 5
+// How far from the prediction a square may be, in its sizes, plus pixels
+#define GATE_SIZES 1.5f
+#define GATE_PIXELS 8.0f
+// Track filter, see AlphaBeta. Misses are counted in frames, so coasting
+// only has to outlast them.
+#define TRACK_ALPHA 0.6f
+#define TRACK_BETA 0.2f
+#define TRACK_COAST 1.0f
+
+typedef struct
+{
+  float cost;
+  int track , square;
+} Candidate;
+
+void tracker_init( Tracker * tr )
+{
+  memset( tr , 0 , sizeof( Tracker ) );
+  tr->next_id = 1;
+}
+
+// Arena bytes tracker_update needs with up to squares squares.
+size_t tracker_size( int squares )
+{
+  return MAX_TRACKS * CANDIDATES * sizeof( Candidate ) + 2 * squares * sizeof( int ) + 3 * ARENA_ALIGN;
+}
+
+// The track with this id, NULL if it is gone.
+const Track * tracker_find( const Tracker * tr , int id )
+{
+  int i;
+  for( i = 0; i < tr->count; i++ )
+    if( tr->tracks[i].id == id ) return &tr->tracks[i];
+  return NULL;
+}
+
+static float square_size( const SquareTable * t , int i )
+{
+  return ( t->w[i] + t->h[i] ) / 2.0f;
+}
+
+// Keeps the n nearest candidates of one track in order, returns how many.
+static int keep_nearest( Candidate * c , int n , Candidate add )
+{
+  int j;
+  if( n == CANDIDATES && add.cost >= c[n-1].cost ) return n;
+  if( n < CANDIDATES ) n++;
+  for( j = n - 1; j > 0 && c[j-1].cost > add.cost; j-- ) c[j] = c[j-1];
+  c[j] = add;
+  return n;
+}
+
+static void start_track( Tracker * tr , const SquareTable * t , int i , double time )
+{
+  Track * k = &tr->tracks[tr->count++];
+  float z[3] = { ( float ) t->fx[i] / REFINE_ONE , ( float ) t->fy[i] / REFINE_ONE , square_size( t , i ) };
+  k->id = tr->next_id++;
+  k->hits = 1;
+  k->confirmed = 0;
+  k->misses = 0;
+  k->square = i;
+  ab_init( &k->f , 3 , TRACK_ALPHA , TRACK_BETA , TRACK_COAST );
+  ab_update( &k->f , z , time );
+}
+
+// Matches this frame's squares, seen at time, to the tracks. ids[i] gets
+// the id of the track square i belongs to, or 0 if it has none yet that
+// counts.
+void tracker_update( Tracker * tr , const SquareTable * t , double time , int * ids , Arena * a )
+{
+  size_t mark = arena_mark( a );
+  int n = t->count;
+  int i , j , k , count = 0 , kept , births , room;
+  float p[3] , dx , dy , gate , size , cost;
+  Candidate * pairs = ( Candidate * ) arena_alloc( a , MAX_TRACKS * CANDIDATES * sizeof( Candidate ) );
+  int * owner = ( int * ) arena_alloc( a , n * sizeof( int ) + 1 );
+  int * born = ( int * ) arena_alloc( a , n * sizeof( int ) + 1 );
+  for( i = 0; i < n; i++ ) ids[i] = 0;
+  if( ! pairs || ! owner || ! born ) goto done;
+  for( i = 0; i < n; i++ ) owner[i] = -1;
+  // Gate every track against the squares
+  for( k = 0; k < tr->count; k++ )
+  {
+    Track * tk = &tr->tracks[k];
+    tk->square = -1;
+    if( ab_predict( &tk->f , time , p ) ) continue;
+    gate = p[2] * GATE_SIZES + GATE_PIXELS;
+    kept = 0;
+    for( i = 0; i < n; i++ )
+    {
+      dx = ( float ) t->fx[i] / REFINE_ONE - p[0];
+      dy = ( float ) t->fy[i] / REFINE_ONE - p[1];
+      if( dx > gate || dx < -gate || dy > gate || dy < -gate ) continue;
+      size = square_size( t , i );
+      if( size > p[2] * MAX_SIZE_CHANGE || p[2] > size * MAX_SIZE_CHANGE ) continue;
+      cost = dx * dx + dy * dy;
+      if( cost > gate * gate ) continue;
+      kept = keep_nearest( pairs + count , kept , ( Candidate ) { cost , k , i } );
+    }
+    count += kept;
+  }
+  // Nearest pairs first, few enough that sorting by insertion is fine
+  for( i = 1; i < count; i++ )
+  {
+    Candidate c = pairs[i];
+    for( j = i; j > 0 && pairs[j-1].cost > c.cost; j-- ) pairs[j] = pairs[j-1];
+    pairs[j] = c;
+  }
+  for( i = 0; i < count; i++ )
+  {
+    Track * tk = &tr->tracks[pairs[i].track];
+    int s = pairs[i].square;
+    if( tk->square >= 0 || owner[s] >= 0 ) continue;
+    tk->square = s;
+    owner[s] = pairs[i].track;
+  }
+  // Update the matched, age the rest, and drop what is gone
+  for( k = 0 , j = 0; k < tr->count; k++ )
+  {
+    Track * tk = &tr->tracks[k];
+    if( tk->square >= 0 )
+    {
+      i = tk->square;
+      p[0] = ( float ) t->fx[i] / REFINE_ONE;
+      p[1] = ( float ) t->fy[i] / REFINE_ONE;
+      p[2] = square_size( t , i );
+      ab_update( &tk->f , p , time );
+      tk->hits++;
+      tk->misses = 0;
+      if( tk->hits >= TRACK_CONFIRM ) tk->confirmed = 1;
+    }else
+    {
+      tk->hits = 0;
+      tk->misses++;
+      // Tracks that never counted go at once
+      if( tk->misses > TRACK_MISSES || ! tk->confirmed || ! tk->f.valid ) continue;
+    }
+    tr->tracks[j++] = *tk;
+  }
+  tr->count = j;
+  // The biggest squares left start tracks, while there is room
+  room = MAX_TRACKS - tr->count;
+  births = 0;
+  for( i = 0; i < n && room; i++ )
+  {
+    if( owner[i] >= 0 ) continue;
+    size = square_size( t , i );
+    if( births == room && size <= square_size( t , born[births-1] ) ) continue;
+    if( births < room ) births++;
+    for( j = births - 1; j > 0 && square_size( t , born[j-1] ) < size; j-- ) born[j] = born[j-1];
+    born[j] = i;
+  }
+  for( i = 0; i < births; i++ ) start_track( tr , t , born[i] , time );
+  for( k = 0; k < tr->count; k++ )
+    if( tr->tracks[k].square >= 0 && tr->tracks[k].confirmed )
+      ids[tr->tracks[k].square] = tr->tracks[k].id;
+done:
+  arena_release( a , mark );
+}
@@ -1,9 +1,29 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "include/voideye.h"
+#include "include/lens.h"
+#include "include/label.h"
+#include "include/parlabel.h"
+#include "include/arena.h"
+#include "include/contour.h"
+#include "include/moments.h"
+#include "include/filters.h"
+#include "include/refine.h"
+#include "include/squares.h"
+#include "include/constellation.h"
+#include "include/homography.h"
+#include "include/warp.h"
+#include "include/pose.h"
+#include "include/predict.h"
+#include "include/track.h"
+#include "include/sprite.h"
+#include "include/scale.h"
+#include "include/blend.h"
 #include <SDL/SDL.h>
 #include <SDL/SDL_image.h>
 #include <math.h>
+#include <time.h>
 
 #define INPUT_WIDTH 640
 #define INPUT_HEIGHT 480
@@ -12,7 +32,9 @@
 #define INPUT_PITCH INPUT_WIDTH * INPUT_BPP
 #define INPUT_SIZE INPUT_WIDTH * INPUT_HEIGHT
 
+#ifndef DS_SCALE
 #define DS_SCALE 5
+#endif
 #define DS_WIDTH INPUT_WIDTH / DS_SCALE
 #define DS_HEIGHT INPUT_HEIGHT / DS_SCALE
 #define DS_DEPTH 24
@@ -20,6 +42,12 @@
 #define DS_PITCH DS_WIDTH * DS_BPP
 #define DS_SIZE DS_WIDTH * DS_HEIGHT
 
+// Every level halves the one below it, DS_WIDTH and DS_HEIGHT should be
+// divisible by 2^(PYR_LEVELS-1).
+#ifndef PYR_LEVELS
+#define PYR_LEVELS 3
+#endif
+
 #define MASK_R 0xFF
 #define MASK_G 0xFF00
 #define MASK_B 0xFF0000
@@ -27,7 +55,53 @@
 
 #define forrange( X , Y ) for( X = 0; X < Y; X++ )
 
-typedef unsigned char byte;
+// Frames before heap allocations in the loop count as a bug
+#define WARMUP_FRAMES 3
+
+// Distance between the centres of the markers on the board, the pose comes
+// out in the same unit
+#ifndef BOARD_WIDTH
+#define BOARD_WIDTH 200.0f
+#endif
+#ifndef BOARD_HEIGHT
+#define BOARD_HEIGHT 150.0f
+#endif
+
+// Full resolution pixels the board corners have to move in all before
+// another calibration view is taken
+#define CALIB_MOTION 40
+
+// Smoothing of what gets drawn. How much of every new measurement is taken
+// in, how much of it goes into the rate, and how many seconds to keep
+// predicting through a dropout before the overlay goes.
+#define SMOOTH_ALPHA 0.5f
+#define SMOOTH_BETA 0.1f
+#define COAST_TIME 0.3f
+// Share of every frame's capture to display time going into the estimate
+#define LATENCY_GAIN 0.1f
+
+// Predictive scanning. Around every marker of the board only a window of
+// its size times ROI_SIZES plus ROI_CELLS cells is looked at next frame,
+// widened by ROI_SPEED of how far it is expected to move. The whole frame
+// is still scanned every FULL_SCAN_PERIOD frames, for new markers.
+#define ROI_SIZES 1.5f
+#define ROI_CELLS 2
+#define ROI_SPEED 0.5f
+#define FULL_SCAN_PERIOD 30
+// Windows are aligned to this many cells, so every level of the pyramid
+// has them on whole cells
+#define ROI_ALIGN ( 1 << ( PYR_LEVELS - 1 ) )
+
+// A partly hidden board is placed from the markers still in view for at
+// most this many frames in a row before searching for it again. A square
+// within REACQUIRE_SIZES marker sizes of where a hidden one should be
+// brings it back.
+#define MAX_DEGRADED 90
+#define REACQUIRE_SIZES 1.0f
+
+// Extra full resolution pixels around a square when refining it. Edge
+// pixels below the cell threshold still carry some of the marker.
+#define REFINE_MARGIN DS_SCALE
 
 typedef struct
 {
@@ -45,61 +119,100 @@ typedef struct
 } APixel;
 
 typedef struct
-{
-  byte colour;
-  int id;
-} Unit;
-
-typedef struct
-{
-  short w,h;
-  Unit * units;
-} Cell;
-
-typedef struct 
 {
   int x , y;
-  int id;
-} Job;
+  int distance;
+} Indicator;
 
+// Everything a frame found about the board.
 typedef struct
 {
-  int id;
-  int count;
-  int maxx,minx,maxy,miny;
-} Group;
+  int found;            // The board was matched, the rest is only valid then
+  int degraded;         // Some markers were hidden, see estimate_board
+  Constellation board;
+  Homography toscreen;  // displayobject pixels onto the window
+  Homography tosprite;  // Window pixels back onto displayobject
+  Indicator indicator;  // Set whenever there were enough squares
+  int posed;            // Found, and the camera is calibrated
+  Pose pose;
+  // The same filtered and predicted to when the frame will be on screen,
+  // coasting through short dropouts. This is what gets drawn.
+  int shown;            // view is valid
+  Indicator view;
+  int warped;           // viewx, viewy and viewtosprite are valid
+  float viewx[4] , viewy[4];
+  Homography viewtosprite;
+  int viewposed;
+  Pose viewpose;
+} FrameResult;
 
+// Level 0 cells from x0, y0 up to but not including x1, y1
 typedef struct
 {
-  int x,y;
-  int size;
-} Square;
+  int x0 , y0 , x1 , y1;
+} Window;
 
 typedef struct
 {
-  int x , y;
-  int distance;
-} Indicator;
+  int w , h;
+  int scale;       // Full resolution pixels per cell
+  short * redness; // Red excess per cell, box filtered from the level below
+  byte * mask;     // Thresholded cells, doubling as the hysteresis state
+  RunMask runs;    // The same cells as runs, what labeling works on
+  Cell cell;       // Units for labeling the dense cells
+} Level;
 
 SDL_Surface * input;
 SDL_Surface * downscale;
-SDL_Surface * displayobject;
+SDL_Surface * displayobject; // Premultiplied, in the window's byte order with alpha on top
 SDL_Surface * window;
 Pixel * pixels;
 Pixel * dspixels;
 Pixel * windowpixels;
+APixel * overlaypixels; // Window sized scratch for the scaled display object
+BlendLayout layout; // Of the window
+SDL_Surface * dsview; // downscale blown up to the window, for debug mode
+SpriteCache sprites; // displayobject at the scales it was recently drawn at
+Arena frame; // Reset at the start of every frame
+Arena outlines; // Contours of the squares, also reset every frame
+Level levels[PYR_LEVELS]; // Detection pyramid, level 0 is the downscaled frame
+LensMap lens; // Undistortion table for the detection grid, map is NULL if uncalibrated
+BlobFilter blobfilter; // What a group needs to become a square, from filters.cfg
+MatchStats matchstats; // How often the board search ran out of pairs
+FrameResult result; // Of the latest frame
+LensCalibration camera; // Intrinsics from lens.cal, fx is 0 without
+Calibration calibration; // Views collected in calibration mode
+Tracker tracker; // Squares followed across frames
+int boardids[4]; // Track ids of the last board found, 0 if not all tracked
+float fullx[4] , fully[4] , fullsize[4]; // Corners of the last board seen whole
+int fullboard = 0; // fullx, fully and fullsize are set
+int degradedrun = 0; // Frames in a row the board was partly hidden
+unsigned degradedframes = 0;
+AlphaBeta smoothindicator; // x, y and distance
+AlphaBeta smoothcorners; // x and y of the board corners
+AlphaBeta smoothpose; // See pose_to_vector
+double captured; // When the current frame came off the camera, in seconds
+double latency = 0.05; // Running estimate from capture to display
+double frametime = 1.0 / 30; // Running estimate between captures
+Window windows[4]; // Where to look next frame, one per marker of the board
+int windowcount = 0; // 0 scans the whole frame
+int sincefull = 0; // Frames since the last full scan
+unsigned fullscans = 0 , roiscans = 0;
 
-int idPool = 1;
-int nextSeed = 0;
-Job * jobQueue;
-int jobQueueIndex = 0;
 
 // RUNTIME FLAGS:
 
 int debugmode = 0;
 int nextflag = 0;
 int avaragesort = 0;
+int connectivity = 4;
+int runlabel = 1; // Label the run lists rather than the dense cells
+int label_threads = LABEL_THREADS;
 int exitflag = 0;
+int red_hysteresis = 10; // Turn-off threshold is red_procentage minus this
+int warpflags = WARP_BILINEAR | WARP_BLEND; // How the display object is drawn onto the board
+int calibrating = 0; // Collecting views of the board to solve the intrinsics from
+int roimode = 1; // Only scan around the markers while the board is tracked
 
 // //
 
@@ -113,6 +226,11 @@ APixel pixel_to_apixel( Pixel p )
   return ( APixel ) { p.r , p.g , p.b , 255 };
 }
 
+double seconds();
+void show_downscale();
+void bench_labeling();
+void finish_calibration();
+
 void handle_input(  )
 {
   while( SDL_PollEvent( &event ) )
@@ -136,9 +254,24 @@ void handle_input(  )
           case SDLK_DOWN:
             red_procentage -= 5;
             break;
+          case SDLK_RIGHT:
+            red_hysteresis += 5;
+            printf( "Hysteresis: %d\n" , red_hysteresis );
+            break;
+          case SDLK_LEFT:
+            if( red_hysteresis >= 5 ) red_hysteresis -= 5;
+            printf( "Hysteresis: %d\n" , red_hysteresis );
+            break;
           case SDLK_SPACE:
             nextflag = 1;
             break;
+          case SDLK_b:
+            bench_labeling();
+            break;
+          case SDLK_k:
+            filter_report( &blobfilter );
+            match_report( &matchstats );
+            break;
           case SDLK_ESCAPE:
             exitflag = 1;
             debugmode = 0;
@@ -154,7 +287,36 @@ void handle_input(  )
             break;
           case SDLK_f:
             avaragesort = 1;
-            printf("Doing avaragesort instead.\n", );
+            printf("Doing avaragesort instead.\n");
+            break;
+          case SDLK_r:
+            runlabel = ! runlabel;
+            printf( "Labeling %s.\n" , runlabel ? "runs" : "cells" );
+            break;
+          case SDLK_t:
+            label_threads = label_threads % LABEL_THREADS + 1;
+            printf( "Labeling on %d threads.\n" , label_threads );
+            break;
+          case SDLK_c:
+            if( ( calibrating = ! calibrating ) )
+            {
+              calib_reset( &calibration );
+              printf( "Calibrating, show the board from many angles and press c again.\n" );
+            }else
+              finish_calibration();
+            break;
+          case SDLK_w:
+            warpflags ^= WARP_BILINEAR;
+            printf( "Bilinear filtering %s.\n" , warpflags & WARP_BILINEAR ? "on" : "off" );
+            break;
+          case SDLK_o:
+            roimode = ! roimode;
+            printf( "Scanning %s, %u full and %u partial scans so far, %u frames degraded.\n" ,
+                    roimode ? "around the markers" : "the whole frame" , fullscans , roiscans , degradedframes );
+            break;
+          case SDLK_8:
+            connectivity = connectivity == 4 ? 8 : 4;
+            printf( "Grouping with %d-connectivity.\n" , connectivity );
             break;
           case SDLK_ESCAPE:
             exitflag = 1;
@@ -179,6 +341,46 @@ void wait_for_next()
   nextflag = 0;
 }
 
+// Worst case for one frame: labeling scratch and squares for every level,
+// picking among the squares, plus room for the labeling benchmark on level 0.
+size_t frame_arena_size()
+{
+  size_t size = 0;
+  size_t entries , squares = 0;
+  int l , runs , table;
+  forrange( l , PYR_LEVELS )
+  {
+    Level * lv = &levels[l];
+    runs = lv->h * ( ( lv->w + 1 ) / 2 ) + 1;
+    table = label_table_size( lv->w , lv->h );
+    entries = runs > table ? runs : table;
+    size += entries * ( sizeof( int ) + sizeof( Blob ) + 1 ) + squares_size( entries ) + 3 * ARENA_ALIGN;
+    if( l == 0 ) size += entries * ( sizeof( int ) + sizeof( Blob ) ) + 2 * ARENA_ALIGN;
+    squares += entries;
+  }
+  // Track ids last the frame, the tracker, squares_top, the matcher and
+  // scaling the overlay don't overlap
+  size += squares * sizeof( int ) + ARENA_ALIGN;
+  size_t select = squares * 2 * sizeof( int ) + 2 * ARENA_ALIGN;
+  size_t match = constellation_size( INPUT_WIDTH , INPUT_HEIGHT , squares );
+  size_t track = tracker_size( squares );
+  size_t scale = scale_size( INPUT_WIDTH );
+  if( match > select ) select = match;
+  if( scale > track ) track = scale;
+  return size + ( select > track ? select : track );
+}
+
+// Longest walk around a group of count cells
+#define max_contour( count ) ( 4 * ( count ) + 4 )
+
+// Tracing a group as big as level 0 needs the chain, a point per step and
+// the simplification scratch. What is kept afterwards is a handful of
+// corners per square.
+size_t outline_arena_size()
+{
+  return max_contour( DS_SIZE ) * ( 1 + sizeof( Point ) + 1 + 2 * sizeof( int ) ) + 64 * 1024;
+}
+
 void init_test( const char * fname )
 {
   atexit( quit_test );
@@ -205,7 +407,16 @@ void init_test( const char * fname )
   }
 
   printf( "Creating a window.\n" );
-  window = SDL_SetVideoMode(640, 480, 0, SDL_FULLSCREEN | SDL_SWSURFACE);
+  // Drawing straight onto the screen's own depth saves converting every
+  // flip. Only when the blend can't handle that, as with 16 bit, is it
+  // 32 bit and SDL converts on flipping.
+  window = SDL_SetVideoMode(640, 480, 0, SDL_FULLSCREEN | SDL_SWSURFACE | SDL_ANYFORMAT);
+  SDL_PixelFormat * wf = window ? window->format : NULL;
+  if( wf && blend_layout( wf->BytesPerPixel , wf->Rmask , wf->Gmask , wf->Bmask , &layout ) )
+  {
+    printf( "Can't draw onto the %d bit screen, using 32 bit.\n" , wf->BitsPerPixel );
+    window = SDL_SetVideoMode(640, 480, 32, SDL_FULLSCREEN | SDL_SWSURFACE);
+  }
   if( ! window )
   {
     printf( "Failed to create window: %s\n" , SDL_GetError() );
@@ -213,9 +424,43 @@ void init_test( const char * fname )
   }
   windowpixels = window->pixels;
   printf( "Window pixels: %x" , windowpixels );
+  wf = window->format;
+  if( blend_layout( wf->BytesPerPixel , wf->Rmask , wf->Gmask , wf->Bmask , &layout ) )
+  {
+    printf( "Can't draw onto a %d bit window.\n" , wf->BitsPerPixel );
+    exit( 1 );
+  }
+  // Every overlay comes from the display object, so
+  // putting it in the window's layout and premultiplying it once here
+  // leaves only the blend for every frame
+  SDL_Surface * loaded = displayobject;
+  displayobject = SDL_CreateRGBSurface( SDL_SWSURFACE , loaded->w , loaded->h , 32 , 0xFFu << layout.r * 8 ,
+                                        0xFFu << layout.g * 8 , 0xFFu << layout.b * 8 , 0xFF000000 );
+  if( ! displayobject )
+  {
+    printf( "Failed to convert the display object: %s\n" , SDL_GetError() );
+    exit( 1 );
+  }
+  // Copy the alpha over rather than blending with it
+  SDL_SetAlpha( loaded , 0 , 255 );
+  SDL_BlitSurface( loaded , NULL , displayobject , NULL );
+  SDL_FreeSurface( loaded );
+  blend_premultiply( displayobject->pixels , displayobject->pitch , displayobject->w , displayobject->h );
+  overlaypixels = ( APixel * ) malloc( sizeof( APixel ) * window->w * window->h );
+  dsview = SDL_CreateRGBSurface( SDL_SWSURFACE , window->w , window->h , DS_DEPTH , MASK_R , MASK_G , MASK_B , MASK_A );
+  if( ! overlaypixels || ! dsview ||
+      sprite_init( &sprites , displayobject->pixels , displayobject->w , displayobject->h , displayobject->pitch ,
+                   window->w , window->h ) )
+  {
+    printf( "Failed to make the sprite cache: %s\n" , SDL_GetError() );
+    exit( 1 );
+  }
   
   red_procentage = (int)fname;
 
+  if( parlabel_init( LABEL_THREADS ) )
+    printf( "Failed to start all labeling threads.\n" );
+
   printf( "Starting camera\n" );
   if( init_cam() )
   {
@@ -224,6 +469,45 @@ void init_test( const char * fname )
   } 
   pixels = ( Pixel * ) malloc( INPUT_SIZE * sizeof( Pixel ) );
   dspixels = ( Pixel * ) malloc( DS_SIZE * sizeof( Pixel ) ); // Downscaled version
+  int l;
+  forrange( l , PYR_LEVELS )
+  {
+    Level * lv = &levels[l];
+    lv->w = DS_WIDTH >> l;
+    lv->h = DS_HEIGHT >> l;
+    lv->scale = DS_SCALE << l;
+    lv->redness = ( short * ) malloc( lv->w * lv->h * sizeof( short ) );
+    lv->mask = ( byte * ) calloc( lv->w * lv->h , sizeof( byte ) );
+    runs_init( &lv->runs , lv->w , lv->h );
+    lv->cell.w = lv->w;
+    lv->cell.h = lv->h;
+    lv->cell.units = ( Unit * ) malloc( lv->w * lv->h * sizeof( Unit ) );
+  }
+  if( arena_init( &outlines , outline_arena_size() ) )
+  {
+    printf( "Failed to allocate the outline arena.\n" );
+    exit( 1 );
+  }
+  if( arena_init( &frame , frame_arena_size() ) )
+  {
+    printf( "Failed to allocate the frame arena.\n" );
+    exit( 1 );
+  }
+
+  ab_init( &smoothindicator , 3 , SMOOTH_ALPHA , SMOOTH_BETA , COAST_TIME );
+  ab_init( &smoothcorners , 8 , SMOOTH_ALPHA , SMOOTH_BETA , COAST_TIME );
+  ab_init( &smoothpose , 6 , SMOOTH_ALPHA , SMOOTH_BETA , COAST_TIME );
+  tracker_init( &tracker );
+
+  if( filter_load( &blobfilter , "./filters.cfg" ) )
+    printf( "No filters.cfg, using the default blob filter.\n" );
+
+  if( lens_load_calibration( "./lens.cal" , &camera ) )
+  {
+    memset( &camera , 0 , sizeof( camera ) );
+    printf( "No lens calibration, detecting on the distorted frame.\n" );
+  }else if( lens_open( &lens , &camera , "./lens.lut" , DS_WIDTH , DS_HEIGHT , DS_SCALE , INPUT_WIDTH , INPUT_HEIGHT ) )
+    printf( "Failed to set up the lens table, detecting on the distorted frame.\n" );
   input = SDL_CreateRGBSurfaceFrom( (byte *)pixels , INPUT_WIDTH, INPUT_HEIGHT, INPUT_DEPTH, INPUT_PITCH, MASK_R , MASK_G , MASK_B , MASK_A );
   downscale = SDL_CreateRGBSurfaceFrom( (byte *)dspixels , DS_WIDTH, DS_HEIGHT, DS_DEPTH, DS_PITCH, MASK_R , MASK_G , MASK_B , MASK_A );
   if( !input )
@@ -298,214 +582,279 @@ void find_avarage()
 #define at( x , y ) x + ( y * INPUT_WIDTH )
 #define dsat( x , y ) x + ( y * DS_WIDTH )
 
-void do_downscale()
+// Samples cells x0 up to x1 of grid row y from the frame.
+void downscale_span( int y , int x0 , int x1 )
 {
-  printf( "Downscaling.\n" );
-  int x,y;
-  for( x = 0; x < DS_WIDTH; x++ ) 
-    for( y = 0; y < DS_HEIGHT; y++ )
+  int x;
+  if( lens.map )
+  {
+    // Sample where the lens actually imaged each grid point
+    LensPoint * lp = lens.map + dsat( x0 , y );
+    int half = LENS_ONE / 2;
+    int sx , sy;
+    for( x = x0; x < x1; x++, lp++ )
     {
-      dspixels[dsat( x , y )] = pixels[at( x * 5 , y * 5 )];
+      sx = ( lp->x + half ) >> LENS_SHIFT;
+      sy = ( lp->y + half ) >> LENS_SHIFT;
+      dspixels[dsat( x , y )] = pixels[at( sx , sy )];
     }
+    return;
+  }
+  for( x = x0; x < x1; x++ )
+    dspixels[dsat( x , y )] = pixels[at( x * DS_SCALE , y * DS_SCALE )];
 }
 
-void apply_contrast( int amount )
+// The parts of row y of level l to look at this frame, as start and end
+// pairs in order, merged where they touch. Returns how many.
+int row_spans( int l , int y , int * spans )
 {
-  //find_avarage();
-  do_downscale();
-  int i;
-  for( i = 0; i < DS_SIZE; i ++ )
+  int n = 0 , i , j , x0 , x1;
+  if( ! windowcount )
   {
-    int total = ( dspixels[i].g + dspixels[i].b ) / 2;
-    int rp = dspixels[i].r - total;
-    if( rp >= red_procentage )
-      dspixels[i] = ( Pixel ) { 0xFF , 0xFF , 0xFF };
-    else
-      dspixels[i] = ( Pixel ) { 0x00 , 0x00 , 0x00 };
+    spans[0] = 0;
+    spans[1] = levels[l].w;
+    return 1;
   }
-  if( debugmode )
+  forrange( i , windowcount )
   {
-    SDL_BlitSurface( downscale, NULL, window, NULL );
-    SDL_Flip( window );
-    SDL_Delay( 0 );
-    wait_for_next();
+    Window * wd = &windows[i];
+    if( y < wd->y0 >> l || y >= wd->y1 >> l ) continue;
+    x0 = wd->x0 >> l;
+    x1 = wd->x1 >> l;
+    for( j = n; j > 0 && spans[j*2-2] > x0; j-- )
+    {
+      spans[j*2] = spans[j*2-2];
+      spans[j*2+1] = spans[j*2-1];
+    }
+    spans[j*2] = x0;
+    spans[j*2+1] = x1;
+    n++;
   }
+  if( ! n ) return 0;
+  for( i = 1 , j = 0; i < n; i++ )
+    if( spans[i*2] <= spans[j*2+1] )
+    {
+      if( spans[i*2+1] > spans[j*2+1] ) spans[j*2+1] = spans[i*2+1];
+    }else
+    {
+      j++;
+      spans[j*2] = spans[i*2];
+      spans[j*2+1] = spans[i*2+1];
+    }
+  return j + 1;
 }
 
-void queue_job( Job job )
+// Halve src into dst with a 2x2 box filter, thresholding in the same pass.
+// Cells outside this frame's windows are cleared.
+void build_level( Level * dst , Level * src , int l )
 {
-  jobQueue[jobQueueIndex++] = job;
+  int x , y , rp , s , n , i , end;
+  int on = red_procentage;
+  int off = red_procentage - red_hysteresis;
+  int spans[2 * 4];
+  runs_reset( &dst->runs );
+  for( y = 0; y < dst->h; y++ )
+  {
+    short * r0 = src->redness + ( y * 2 ) * src->w;
+    short * r1 = r0 + src->w;
+    byte * mask = dst->mask + y * dst->w;
+    n = row_spans( l , y , spans );
+    for( s = 0 , x = 0; s <= n; s++ )
+    {
+      end = s < n ? spans[s*2] : dst->w;
+      memset( mask + x , 0 , end - x );
+      if( s == n ) break;
+      i = y * dst->w;
+      for( x = spans[s*2]; x < spans[s*2+1]; x++ )
+      {
+        rp = ( r0[x*2] + r0[x*2+1] + r1[x*2] + r1[x*2+1] ) >> 2;
+        dst->redness[i+x] = rp;
+        mask[x] = rp >= ( mask[x] ? off : on );
+      }
+    }
+    runs_add_spans( &dst->runs , mask , y , spans , n );
+  }
 }
 
-int biggesty = 0;
+// Window edge in cells, aligned for the coarsest level and inside 0..hi.
+int window_edge( int v , int hi )
+{
+  if( v < 0 ) return 0;
+  if( v > hi ) return hi;
+  return v & ~( ROI_ALIGN - 1 );
+}
 
-void seed_search( Cell * cell , int x , int y , int groupid )
+// Plans the windows for the next frame around where the board's markers
+// will be, or a full scan if any of them is lost or one is due.
+void plan_windows( FrameResult * r )
 {
-  int pos = dsat( x , y );
-  Unit * units = cell->units;
-  if( units[pos].colour != 0xFF || units[pos].id != 0 )
+  int i , n = 0 , x0 , y0 , x1 , y1;
+  float p[3] , pad;
+  AlphaBeta f;
+  Window * wd;
+  windowcount = 0;
+  if( ! roimode || ! r->found || ++sincefull >= FULL_SCAN_PERIOD ) goto full;
+  forrange( i , 4 )
   {
-    return;
-  }
-  units[pos].id = groupid;
-  if( x > 0 )
-  {
-    queue_job( ( Job ){ x - 1 , y , groupid } );
-  }
-  if( y > 0 )
-  {
-    queue_job( ( Job ){ x , y - 1 , groupid } );
+    const Track * k = r->board.id[i] ? tracker_find( &tracker , r->board.id[i] ) : NULL;
+    if( k && k->square >= 0 )
+    {
+      f = k->f;
+      ab_predict( &f , captured + frametime , p );
+      pad = p[2] * ROI_SIZES + ( fabsf( f.v[0] ) + fabsf( f.v[1] ) ) * frametime * ROI_SPEED;
+    }else if( r->degraded )
+    {
+      // Keep looking where the hidden marker should come back
+      p[0] = ( float ) r->board.x[i] / REFINE_ONE;
+      p[1] = ( float ) r->board.y[i] / REFINE_ONE;
+      // Slid out of view, it can't come back until the board does
+      if( p[0] < 0 || p[0] >= INPUT_WIDTH || p[1] < 0 || p[1] >= INPUT_HEIGHT ) continue;
+      pad = fullsize[i] * ROI_SIZES;
+    }else
+      goto full;
+    // Cells of the undistorted grid are DS_SCALE full resolution pixels apart
+    x0 = ( p[0] - pad ) / DS_SCALE - ROI_CELLS;
+    y0 = ( p[1] - pad ) / DS_SCALE - ROI_CELLS;
+    x1 = ( p[0] + pad ) / DS_SCALE + ROI_CELLS + ROI_ALIGN;
+    y1 = ( p[1] + pad ) / DS_SCALE + ROI_CELLS + ROI_ALIGN;
+    wd = &windows[n];
+    wd->x0 = window_edge( x0 , DS_WIDTH );
+    wd->y0 = window_edge( y0 , DS_HEIGHT );
+    wd->x1 = window_edge( x1 , DS_WIDTH );
+    wd->y1 = window_edge( y1 , DS_HEIGHT );
+    // Predicted off the frame, nothing there to look at
+    if( wd->x0 >= wd->x1 || wd->y0 >= wd->y1 ) continue;
+    n++;
   }
-  if( y < ( cell->h - 1 ))
+  if( ! n ) goto full;
+  windowcount = n;
+  return;
+full:
+  sincefull = 0;
+}
+
+void apply_contrast( int amount )
+{
+  //find_avarage();
+  int i , x , y , s , n , end;
+  int on = red_procentage;
+  int off = red_procentage - red_hysteresis;
+  short * redness = levels[0].redness;
+  byte * mask = levels[0].mask;
+  int spans[2 * 4];
+  if( windowcount ) roiscans++;
+  else fullscans++;
+  printf( "Downscaling %s.\n" , windowcount ? "around the markers" : "the whole frame" );
+  runs_reset( &levels[0].runs );
+  for( y = 0; y < DS_HEIGHT; y++ )
   {
-    queue_job( ( Job ){ x , y + 1 , groupid } );
+    n = row_spans( 0 , y , spans );
+    for( s = 0 , x = 0; s <= n; s++ )
+    {
+      // Nothing left over from when the gap was looked at
+      end = s < n ? spans[s*2] : DS_WIDTH;
+      memset( mask + dsat( x , y ) , 0 , end - x );
+      memset( dspixels + dsat( x , y ) , 0 , ( end - x ) * sizeof( Pixel ) );
+      if( s == n ) break;
+      downscale_span( y , spans[s*2] , spans[s*2+1] );
+      for( x = spans[s*2] , i = dsat( x , y ); x < spans[s*2+1]; x++ , i++ )
+      {
+        int total = ( dspixels[i].g + dspixels[i].b ) / 2;
+        int rp = dspixels[i].r - total;
+        redness[i] = rp;
+        // A cell that was on last frame only turns off once it drops below the
+        // lower threshold, so cells sitting on the edge don't flicker.
+        mask[i] = rp >= ( mask[i] ? off : on );
+        if( mask[i] )
+          dspixels[i] = ( Pixel ) { 0xFF , 0xFF , 0xFF };
+        else
+          dspixels[i] = ( Pixel ) { 0x00 , 0x00 , 0x00 };
+      }
+    }
+    // Still in cache, turn the row into runs for labeling
+    runs_add_spans( &levels[0].runs , mask + y * DS_WIDTH , y , spans , n );
   }
-  if( x < ( cell->w - 1 ))
+  for( i = 1; i < PYR_LEVELS; i++ )
+    build_level( &levels[i] , &levels[i-1] , i );
+  if( debugmode )
   {
-    queue_job( ( Job ){ x + 1 , y , groupid } );
+    show_downscale();
+    wait_for_next();
   }
 }
 
-int scan_for_seed( Cell * cell )
+// Groups the cell, blobs needs label_table_size entries.
+int unitize_cell( Cell * cell , Blob * blobs )
 {
-  if( nextSeed == -1 ) return nextSeed;
-  int i;
-  for( i = 0; i < DS_SIZE; i++ )
-    if( cell->units[i].id == 0 && cell->units[i].colour == 0xFF )
-      return ( nextSeed = i );
-  printf("No seeds left!\n");
-  return ( nextSeed = -1 );
-}
-
-void unitize_cell( Cell * cell )
-{
-  jobQueue = ( Job * ) malloc( ( DS_SIZE ) * sizeof( Job ) * 2 );
-  printf("Queue size: %d bytes\n", DS_SIZE * sizeof( Job ) * 2 );
+  int * parent = ( int * ) arena_alloc( &frame , label_table_size( cell->w , cell->h ) * sizeof( int ) );
   printf( "Starting grouping:\n" );
-  idPool = 1;
-  jobQueueIndex = 0;
-  nextSeed = 0;
-  // Search for ungrouped sample
-  while( scan_for_seed( cell ) != -1 )
-  {
-    // Queue the the sample
-    queue_job( ( Job ) { nextSeed % cell->w , nextSeed / cell->w , idPool++ } );
-    // While the queue isn't empty
-    while( jobQueueIndex )
-    {
-       // Pop a job from the queue
-      Job currentJob = jobQueue[ --jobQueueIndex ];
-      // Perform search on the current job sample
-      seed_search( cell , currentJob.x , currentJob.y , currentJob.id );
-    }
-  }
-  free( jobQueue );
-  printf("Ended grouping with %d groups.\n", idPool - 1 );
+  int count = label_cell( cell , connectivity , parent , blobs );
+  printf("Ended grouping with %d groups.\n", count );
+  return count;
 }
 
-Cell * create_cell()
+Cell * create_cell( Level * level )
 {
-  // allocate the needed data
-  Unit * units = ( Unit * ) malloc( DS_SIZE * sizeof( Unit ) );
-  printf( "Allocated %d bytes.\n" , DS_SIZE * sizeof( Unit ) );
-  Cell * cell = ( Cell * ) malloc( sizeof( Cell ) );
-  cell->units = units;
-  cell->w = DS_WIDTH;
-  cell->h = DS_HEIGHT;
+  int size = level->w * level->h;
+  Cell * cell = &level->cell;
+  Unit * units = cell->units;
   int i;
-  for( i = 0; i < DS_SIZE; i++ )
+  for( i = 0; i < size; i++ )
   {
-    // Assign the colour to be that of the pixel, and the group to be NULL.
-    units[i] = ( Unit ) { dspixels[i].r , 0 };
+    // Assign the colour to be that of the mask, and the group to be NULL.
+    units[i] = ( Unit ) { level->mask[i] ? 0xFF : 0x00 , 0 };
   }
   return cell;
 }
 
-Square * group_units( Cell * cell , int * sc )
+// Traces the outline of a group that made it, for its corners.
+Contour * outline_blob( Level * lv , Blob * g )
 {
-  Group * groups = ( Group * ) malloc( sizeof( Group ) * (idPool ) );
-  int i,x,y;
-  Group * g;
-  printf( "Grouping groups.\n" );
-  for( i = 0; i < idPool; i++)
-    groups[i] = ( Group ) { i+1 , 0 , -1 , -1 , -1 , -1 };
-  // Build groups
-  int biggesti = 0;
-  for( x = 0; x < DS_WIDTH; x++  )
-  for( y = 0; y < DS_HEIGHT; y++ )
+  int i;
+  Contour * c = trace_contour( &outlines , lv->mask , lv->w , lv->h , g->firstx , g->miny ,
+                               connectivity , max_contour( g->count ) , 1 );
+  if( ! c || ! c->polygon ) return NULL;
+  forrange( i , c->corners )
   {
-    i = x + ( y * DS_WIDTH );
-    if( cell->units[i].colour != 0xFF ) continue; // I know it's racist.
-    g = &( groups[ cell->units[i].id-1 ] );
-    biggesti = y;
-    g->count++;
-    // MIN X
-    if( g->minx == -1 )
-      g->minx = x;
-    else
-      g->minx = x < g->minx ? x : g->minx;
-    // MAX X
-    if( g->maxx == -1 )
-      g->maxx = x;
-    else
-      g->maxx = x > g->maxx ? x : g->maxx;
-    // MIN Y
-    if( g->miny == -1 )
-     g->miny = y;
-    else
-      g->miny = y < g->miny ? y : g->miny;
-    // MAX Y
-    if( g->maxy == -1 )
-      g->maxy = y;
-    else
-      g->maxy = y > g->maxy ? y : g->maxy;
+    c->polygon[i].x = c->polygon[i].x * lv->scale + lv->scale / 2;
+    c->polygon[i].y = c->polygon[i].y * lv->scale + lv->scale / 2;
   }
-  printf( "(%d)Building squares.\n" , biggesti );
-  // Destroy incompetent groups
-  Square * squares = ( Square * ) malloc( sizeof( Square ) * (idPool - 1 ) );
-  int squarecount = 0;
+  return c;
+}
+
+// Squares come out in full resolution pixels, scaled by the level's cell
+// size. The groups have to have passed the blob filter already. squares
+// needs room for count more entries, returns how many were made.
+int build_squares( Level * lv , Blob * blobs , int count , SquareTable * squares )
+{
+  int scale = lv->scale;
+  int i , s;
+  Blob * g;
   int width,height;
-  for( i = 0; i < idPool; i++)
+  Moments m;
+  for( i = 0; i < count; i++)
   {
-    g = &( groups[i] );
-    printf( "%dx[ %d-%d | %d-%d ]: " , g->count , g->minx , g->maxx , g->miny , g->maxy );
-    if( g->count <= 5 )
-    {
-      printf( "To few members, %d <= 5\n" , g->count );
-      continue;
-    }
+    g = &( blobs[i] );
     width = g->maxx - g->minx;
-    if( width <= 2 )
-    {
-      printf( "Too slim, %d <= 2\n" , width );
-      continue;
-    }
     height = g->maxy - g->miny;
-    if( height <= 2 )
-    {
-      printf( "Too small, %d <= 2\n" , height );
-      continue;
-    }
-    if( ( height * 100 ) / width > 145 )
-    {
-      printf( "To high, %d > 145\n" , ( height * 100 ) / width );
-      continue;
-    }
-    if( ( width * 100 ) / height > 145 )
-    {
-      printf( "To wide, %d > 145\n" , ( width * 100 ) / height );
-      continue;
-    }
-    printf( "added.\n" );
-    squares[squarecount++] = ( Square ) { g->minx , g->miny  , ( width + height ) / 2 };
+    blob_moments( g , &m );
+    s = squares->count++;
+    squares->x[s] = g->minx * scale;
+    squares->y[s] = g->miny * scale;
+    squares->size[s] = ( ( width + height ) / 2 ) * scale;
+    squares->w[s] = ( width + 1 ) * scale;
+    squares->h[s] = ( height + 1 ) * scale;
+    squares->area[s] = g->count;
+    // Cell centres sit half a cell in
+    squares->cx[s] = ( ( m.cx * scale ) >> MOMENT_SHIFT ) + scale / 2;
+    squares->cy[s] = ( ( m.cy * scale ) >> MOMENT_SHIFT ) + scale / 2;
+    squares->angle[s] = m.angle;
+    squares->eccentricity[s] = m.eccentricity;
+    squares->fill[s] = m.fill;
+    squares->outline[s] = outline_blob( lv , g );
   }
-  printf( "Freeing data.\n" );
-  free( groups );
-  printf( "Resizing array to fit sqaure count.\n" );
-  squares = realloc( squares , sizeof( Square ) * squarecount );
-  *sc = squarecount;
-  printf( "Made %d squares.\n" , squarecount );
-  return squares;
+  printf( "Made %d squares.\n" , count );
+  return count;
 }
 
 int abs( int a )
@@ -513,77 +862,25 @@ int abs( int a )
   return a < 0 ? -a : a;
 }
 
-void sort_squares( Square * squares , int squarecount )
+int sign( int a )
 {
-  int i;
-  Square temp;
-  printf( "Sorting squares!\n" );
-  if( squarecount <= 2 ) return;
-sort:
-  for( i = 0; i < squarecount-1; i++ )
-  {
-    if( squares[i].size < squares[i+1].size )
-    {
-      printf( "%d < %d, swapping %d and %d\n" , squares[i].size , squares[i+1].size , i , i+1 );
-      temp = squares[i];
-      squares[i] = squares[i+1];
-      squares[i+1] = temp;
-      goto sort;
-    }
-  }
-  printf( "Sorted.\n" );
-  return;
+  return a > 0 ? 1 : ( a < 0 ? -1 : 0 );
 }
 
-void avaragesort_squares( Square * squares , int squarecount )
-{
-  int i;
-  int avarage = 0;
-  for( i = 0; i < squarecount; i++ )
-  {
-    avarage += squares[i].size;
-  }
-  avarage /= squarecount;
-  Square temp;
-  printf( "Sorting squares!\n" );
-  if( squarecount <= 2 ) return;
-sort:
-  for( i = 0; i < squarecount-1; i++ )
-  {
-    if( abs( squares[i].size - avarage ) > abs( squares[i+1].size - avarage ) )
-    {
-      printf( "%d > %d, swapping %d and %d\n" ,abs( squares[i].size - avarage ) , abs( squares[i+1].size - avarage ) , i , i+1 );
-      temp = squares[i];
-      squares[i] = squares[i+1];
-      squares[i+1] = temp;
-      goto sort;
-    }
-  }
-  printf( "Sorted.\n" );
-  return;
-}
 
-void render_squares( Square * squares , int squarecount )
+// Puts the detection grid on screen at the window's size, cells blown up
+// without filtering so they stay visible as cells.
+void show_downscale()
 {
-  int i;
-  Square s;
-  for( i = 0; i < squarecount; i++ )
-  {
-    s = squares[i];
-    SDL_Rect rect = { s.x , s.y , s.size , s.size };
-    SDL_FillRect( downscale , &rect , 0xFF0000 );
-  }
-  SDL_BlitSurface( downscale , NULL , window , NULL );
+  if( SDL_MUSTLOCK( dsview ) ) SDL_LockSurface( dsview );
+  scale_image( ( unsigned char * ) dspixels , DS_WIDTH , DS_HEIGHT , DS_PITCH , dsview->pixels ,
+               dsview->w , dsview->h , dsview->pitch , DS_BPP , 0 , 0 , dsview->w , dsview->h , 0 , &frame );
+  if( SDL_MUSTLOCK( dsview ) ) SDL_UnlockSurface( dsview );
+  SDL_BlitSurface( dsview , NULL , window , NULL );
   SDL_Flip( window );
   SDL_Delay( 0 );
 }
 
-int sign( int a )
-{
-  return a > 0 ? 1 : ( a < 0 ? -1 : 0 );
-}
-
-
 void render_line( SDL_Surface * s , int x , int y , int x2 , int y2 , Pixel colour )
 {
   Pixel * px = ( Pixel * ) s->pixels;
@@ -623,93 +920,323 @@ void render_line( SDL_Surface * s , int x , int y , int x2 , int y2 , Pixel colo
   }
 }
 
-void render_center( Square * squares , int squarecount )
+void render_squares( SquareTable * squares )
+{
+  int i;
+  int squarecount = squares->count;
+  for( i = 0; i < squarecount; i++ )
+  {
+    SDL_Rect rect = { squares->x[i] / DS_SCALE , squares->y[i] / DS_SCALE ,
+                      squares->size[i] / DS_SCALE , squares->size[i] / DS_SCALE };
+    SDL_FillRect( downscale , &rect , 0xFF0000 );
+  }
+  // Outlines on top, so they show where the boxes overlap
+  for( i = 0; i < squarecount; i++ )
+  {
+    Contour * c = squares->outline[i];
+    if( ! c ) continue;
+    int j;
+    Point a , b;
+    forrange( j , c->corners )
+    {
+      a = c->polygon[j];
+      b = c->polygon[( j + 1 ) % c->corners];
+      render_line( downscale , a.x / DS_SCALE , a.y / DS_SCALE , b.x / DS_SCALE , b.y / DS_SCALE , ( Pixel ) { 0x00 , 0xFF , 0x00 } );
+    }
+  }
+  show_downscale();
+}
+
+void render_center( SquareTable * squares , const int * pick , int t )
 {
   int ax = 0;
   int ay = 0;
-  int t =  ( squarecount > 4 ? 4 : squarecount );
   int i;
   for( i = 0; i < t; i++ )
   {
-    ax += squares[i].x + ( squares[i].size / 2 );
-    ay += squares[i].y + ( squares[i].size / 2 );
+    ax += squares->cx[pick[i]];
+    ay += squares->cy[pick[i]];
   }
-  ax /= t;
-  ay /= t;
+  ax /= t * DS_SCALE;
+  ay /= t * DS_SCALE;
   render_line( downscale , 0 , ay ,  DS_WIDTH - 1 , ay , ( Pixel ) { 0xFF , 00 , 00 } );
   render_line( downscale , ax , 0 ,  ax , DS_HEIGHT - 1 , ( Pixel ) { 0xFF , 00 , 00 } );
-  SDL_BlitSurface( downscale , NULL  , window , NULL );
-  SDL_Flip( window );
-  SDL_Delay( 0 );  
+  show_downscale();
 }
 
+// Where every counted track is heading, a tenth of a second ahead.
+void render_tracks()
+{
+  int i;
+  forrange( i , tracker.count )
+  {
+    const Track * k = &tracker.tracks[i];
+    if( ! k->confirmed || k->square < 0 ) continue;
+    int x = k->f.x[0] / DS_SCALE , y = k->f.x[1] / DS_SCALE;
+    render_line( downscale , x , y , x + k->f.v[0] / ( 10 * DS_SCALE ) , y + k->f.v[1] / ( 10 * DS_SCALE ) ,
+                 ( Pixel ) { 0xFF , 0xFF , 0x00 } );
+  }
+  show_downscale();
+}
+
+// Blends the w by h premultiplied image src, pitch bytes a row, over dst
+// at x, y. Only the part on dst is touched.
+void composite( const unsigned char * src , int pitch , SDL_Surface * dst , int x , int y , int w , int h )
+{
+  if( x < 0 ) { src -= x * 4; w += x; x = 0; }
+  if( y < 0 ) { src -= y * pitch; h += y; y = 0; }
+  if( x + w > dst->w ) w = dst->w - x;
+  if( y + h > dst->h ) h = dst->h - y;
+  if( w <= 0 || h <= 0 ) return;
+  if( SDL_MUSTLOCK( dst ) ) SDL_LockSurface( dst );
+  blend_over( src , pitch , ( unsigned char * ) dst->pixels + y * dst->pitch + x * layout.bpp , dst->pitch ,
+              layout.bpp , w , h );
+  if( SDL_MUSTLOCK( dst ) ) SDL_UnlockSurface( dst );
+}
+
+// Scales src to w by h at x, y on dst, both like displayobject. Only the
+// part that ends up on dst is scaled, so it always fits the window sized
+// overlay. What fits the sprite cache shouldn't come here.
 void render_scaled_image( SDL_Surface * src , SDL_Surface * dst , int x, int y, int w , int h )
 {
   printf( "Rendering display object!\n" );
-  APixel * apx = ( APixel * ) malloc( sizeof( APixel ) * w * h );
-  int dx , dy; // Destination x , y
-  int sx , sy; // Source x , y
-  double px , py; // Procentage x , y
+  int pitch = dst->w * 4;
+  int x0 = x < 0 ? 0 : x;
+  int y0 = y < 0 ? 0 : y;
+  int x1 = x + w > dst->w ? dst->w : x + w;
+  int y1 = y + h > dst->h ? dst->h : y + h;
+  if( x1 <= x0 || y1 <= y0 ) return;
   printf( "Scaling.\n" );
-  forrange( dx , w )
-    forrange( dy , h )
-    {
-      px = ( double ) dx / ( double ) w;
-      py = ( double ) dy / ( double ) h;
-      sx = src->w * px;
-      sy = src->h * py;
-      apx[ dx + ( dy * w ) ] =
-        ( ( APixel * ) src->pixels )[ sx + ( sy * src->w ) ];
-    }
-  SDL_Surface* temp = SDL_CreateRGBSurfaceFrom( apx , w , h , 32 , w * 4 , 0xFF , 0xFF00 , 0xFF0000 , 0xFF000000 );
-  printf( "Now\n" );
-  SDL_BlitSurface( temp , NULL , window , &( ( SDL_Rect ) { x , y , 0 , 0 } ) );
+  if( scale_image( src->pixels , src->w , src->h , src->pitch , ( unsigned char * ) overlaypixels ,
+                   dst->w , dst->h , pitch , 4 , x , y , w , h , 0 , &frame ) )
+    return;
+  composite( ( unsigned char * ) ( overlaypixels + x0 + y0 * dst->w ) , pitch , dst , x0 , y0 , x1 - x0 , y1 - y0 );
   printf( "Done!\n" );
-  SDL_FreeSurface( temp );
-  free( apx );
+}
+
+// Draws src onto the board corners cx, cy in dst through tosprite. Only
+// the box around them is touched. Returns non zero if it can't, src has to
+// be like displayobject.
+int render_warped_image( SDL_Surface * src , SDL_Surface * dst , const float * cx , const float * cy ,
+                         const Homography * tosprite )
+{
+  int x0 = dst->w , y0 = dst->h , x1 = 0 , y1 = 0;
+  int i , x , y;
+  if( src->format->BytesPerPixel != 4 ) return 1;
+  forrange( i , 4 )
+  {
+    x = cx[i];
+    y = cy[i];
+    if( x < x0 ) x0 = x;
+    if( y < y0 ) y0 = y;
+    if( x + 1 > x1 ) x1 = x + 1;
+    if( y + 1 > y1 ) y1 = y + 1;
+  }
+  if( x0 < 0 ) x0 = 0;
+  if( y0 < 0 ) y0 = 0;
+  if( x1 > dst->w ) x1 = dst->w;
+  if( y1 > dst->h ) y1 = dst->h;
+  if( x1 <= x0 || y1 <= y0 ) return 0;
+  warp_image( ( unsigned char * ) src->pixels , src->w , src->h , src->pitch ,
+              ( unsigned char * ) overlaypixels , dst->w * 4 , x0 , y0 , x1 - x0 , y1 - y0 ,
+              tosprite , warpflags );
+  composite( ( unsigned char * ) overlaypixels , dst->w * 4 , dst , x0 , y0 , x1 - x0 , y1 - y0 );
+  return 0;
 }
 
 int diddisplay = 0;
 
-Indicator get_indication( Square * squares , int squarecount )
+// Works on the refined centroids of the t picked squares and only rounds to
+// pixels at the end, so the indicator moves smoothly instead of in whole
+// cells.
+// x and y of t points in REFINE_ONE units.
+Indicator get_indication( const int * x , const int * y , int t )
 {
   int ax = 0;
   int ay = 0;
-  int ad = 0;
-  int cx , cy;
-  int t =  ( squarecount > 4 ? 4 : squarecount );
+  double ad = 0;
+  double cx , cy;
   int i;
   for( i = 0; i < t; i++ )
   {
-    ax += squares[i].x + ( squares[i].size / 2 );
-    ay += squares[i].y + ( squares[i].size / 2 );
+    ax += x[i];
+    ay += y[i];
   }
   ax /= t;
   ay /= t;
   for( i = 0; i < t; i++ )
   {
-    cx = ax - squares[i].x + ( squares[i].size / 2 );
-    cy = ay - squares[i].y + ( squares[i].size / 2 );
+    cx = ax - x[i];
+    cy = ay - y[i];
     ad += sqrt( cx * cx + cy * cy );
   }
-  ad /= t;
-  return ( Indicator ) { ax*DS_SCALE , ay*DS_SCALE , ad*DS_SCALE };
+  ad /= t * REFINE_ONE;
+  return ( Indicator ) { ( ax + REFINE_ONE / 2 ) >> REFINE_SHIFT , ( ay + REFINE_ONE / 2 ) >> REFINE_SHIFT , ad + 0.5 };
 }
 
-void create_groups()
+// The same marker usually shows up on neighbouring levels. Squares come in
+// finest level first, so keep the first one seen and drop any later square
+// whose centre falls inside it, or which contains its centre. The inner
+// test runs over every earlier square without branching, kept or not, so
+// it vectorizes.
+int merge_scales( SquareTable * squares )
 {
-  Cell * cell = create_cell();
-  unitize_cell( cell );
-  int squarecount = 0;
-  Square * squares = group_units( cell , &squarecount );
-  if( avaragesort ) avaragesort_squares( squares , squarecount );
-  else sort_squares( squares , squarecount );
-  printf( "Rendering\n" );
-  if( debugmode )
+  int n = squares->count;
+  int * x = squares->x , * y = squares->y , * cx = squares->cx , * cy = squares->cy;
+  int * size = squares->size;
+  byte * keep = ( byte * ) arena_alloc( &frame , n );
+  int i , j , hit;
+  forrange( i , n )
   {
-    render_squares( squares , squarecount );
+    int sx = x[i] , sy = y[i] , sx1 = x[i] + size[i] , sy1 = y[i] + size[i];
+    int scx = cx[i] , scy = cy[i];
+    hit = 0;
+    for( j = 0; j < i; j++ )
+      hit |= keep[j] & ( ( ( scx >= x[j] ) & ( scx < x[j] + size[j] ) & ( scy >= y[j] ) & ( scy < y[j] + size[j] ) ) |
+                         ( ( cx[j] >= sx ) & ( cx[j] < sx1 ) & ( cy[j] >= sy ) & ( cy[j] < sy1 ) ) );
+    keep[i] = ! hit;
   }
-  if( squarecount <= 2 )
+  squares_compact( squares , keep );
+  printf( "Merged %d squares across scales into %d.\n" , n , squares->count );
+  return squares->count;
+}
+
+// Redoes the centroids of the squares on the full frame, reading only a
+// window around each box. With a lens table the window is where the lens
+// imaged the box, and the centroid found there is undistorted back onto the
+// grid. Squares that can't be refined keep their coarse centroid.
+void refine_squares( SquareTable * s )
+{
+  int i , x0 , y0 , x1 , y1 , fx , fy;
+  int base = red_procentage - red_hysteresis;
+  // Unrefined squares keep their cell centroid
+  forrange( i , s->count )
+  {
+    s->fx[i] = s->cx[i] << REFINE_SHIFT;
+    s->fy[i] = s->cy[i] << REFINE_SHIFT;
+  }
+  forrange( i , s->count )
+  {
+    if( lens.map )
+      lens_bounds( &lens , s->x[i] / DS_SCALE - 1 , s->y[i] / DS_SCALE - 1 ,
+                   ( s->x[i] + s->w[i] ) / DS_SCALE + 1 , ( s->y[i] + s->h[i] ) / DS_SCALE + 1 ,
+                   &x0 , &y0 , &x1 , &y1 );
+    else
+    {
+      x0 = s->x[i] - REFINE_MARGIN;
+      y0 = s->y[i] - REFINE_MARGIN;
+      x1 = s->x[i] + s->w[i] + REFINE_MARGIN;
+      y1 = s->y[i] + s->h[i] + REFINE_MARGIN;
+    }
+    if( x0 < 0 ) x0 = 0;
+    if( y0 < 0 ) y0 = 0;
+    if( x1 > INPUT_WIDTH ) x1 = INPUT_WIDTH;
+    if( y1 > INPUT_HEIGHT ) y1 = INPUT_HEIGHT;
+    if( refine_centroid( ( byte * ) pixels , INPUT_WIDTH , x0 , y0 , x1 , y1 , base , &fx , &fy ) )
+      continue;
+    if( lens.map )
+    {
+      float gx = ( float ) s->cx[i] / DS_SCALE;
+      float gy = ( float ) s->cy[i] / DS_SCALE;
+      if( lens_undistort( &lens , ( float ) fx / REFINE_ONE , ( float ) fy / REFINE_ONE , &gx , &gy ) )
+        continue;
+      fx = gx * DS_SCALE * REFINE_ONE;
+      fy = gy * DS_SCALE * REFINE_ONE;
+    }
+    s->fx[i] = fx;
+    s->fy[i] = fy;
+    s->cx[i] = ( fx + REFINE_ONE / 2 ) >> REFINE_SHIFT;
+    s->cy[i] = ( fy + REFINE_ONE / 2 ) >> REFINE_SHIFT;
+  }
+}
+
+// Maps displayobject onto the corners x, y and back. Returns non zero if
+// the corners are degenerate.
+int sprite_homography( const float * x , const float * y , Homography * toscreen , Homography * tosprite )
+{
+  if( homography_rect_to_quad( toscreen , displayobject->w , displayobject->h , x , y ) )
+    return 1;
+  return homography_invert( toscreen , tosprite );
+}
+
+int board_homography( FrameResult * r )
+{
+  float x[4] , y[4];
+  int i;
+  forrange( i , 4 )
+  {
+    x[i] = ( float ) r->board.x[i] / REFINE_ONE;
+    y[i] = ( float ) r->board.y[i] / REFINE_ONE;
+  }
+  return sprite_homography( x , y , &r->toscreen , &r->tosprite );
+}
+
+// Folds what this frame measured into the filters, then predicts all of it
+// to when the frame should be on screen. measured says whether the
+// indicator was.
+void track_board( FrameResult * r , int measured )
+{
+  float z[8];
+  double shown = captured + latency;
+  Homography toscreen;
+  int i;
+  // A corner on another track than last time is another board, or the same
+  // markers lost and found again: sliding the overlay over from the old one
+  // would only look wrong. Tracks still being confirmed say nothing.
+  if( r->found )
+  {
+    forrange( i , 4 )
+      if( r->board.id[i] && boardids[i] && r->board.id[i] != boardids[i] )
+      {
+        smoothcorners.valid = 0;
+        smoothpose.valid = 0;
+      }
+    memcpy( boardids , r->board.id , sizeof( boardids ) );
+  }
+  if( measured )
+  {
+    z[0] = r->indicator.x;
+    z[1] = r->indicator.y;
+    z[2] = r->indicator.distance;
+    ab_update( &smoothindicator , z , captured );
+  }
+  if( r->found )
+  {
+    forrange( i , 4 )
+    {
+      z[i*2] = ( float ) r->board.x[i] / REFINE_ONE;
+      z[i*2+1] = ( float ) r->board.y[i] / REFINE_ONE;
+    }
+    ab_update( &smoothcorners , z , captured );
+  }
+  if( r->posed )
+  {
+    pose_to_vector( &r->pose , z );
+    ab_update( &smoothpose , z , captured );
+  }
+  r->shown = ! ab_predict( &smoothindicator , shown , z );
+  if( r->shown )
+    r->view = ( Indicator ) { z[0] + 0.5f , z[1] + 0.5f , z[2] + 0.5f };
+  r->warped = ! ab_predict( &smoothcorners , shown , z );
+  if( r->warped )
+  {
+    forrange( i , 4 )
+    {
+      r->viewx[i] = z[i*2];
+      r->viewy[i] = z[i*2+1];
+    }
+    r->warped = ! sprite_homography( r->viewx , r->viewy , &toscreen , &r->viewtosprite );
+  }
+  r->viewposed = ! ab_predict( &smoothpose , shown , z );
+  if( r->viewposed ) pose_from_vector( z , &r->viewpose );
+}
+
+// Draws the overlay as track_board predicted it.
+void present( FrameResult * r )
+{
+  if( r->viewposed )
+    printf( "Board at %.1f %.1f %.1f\n" , r->viewpose.t[0] , r->viewpose.t[1] , r->viewpose.t[2] );
+  if( ! r->shown )
   {
     printf( "Not enough squares to build area.\n" );
     if( ! diddisplay )
@@ -719,13 +1246,7 @@ void create_groups()
     }
   }else
   {
-    if( debugmode )
-    {
-      render_center( squares , squarecount );
-      wait_for_next();
-    }
-    Indicator indic = get_indication( squares , squarecount );
-    printf("Indicator %d %d : %d\n" , indic.x , indic.y , indic.distance );
+    Indicator indic = r->view;
     int px , py , pw , ph;
     double scale = (double) indic.distance / ( double ) 100 ;
     pw = displayobject->w * scale;
@@ -734,12 +1255,338 @@ void create_groups()
     py = indic.y - ph / 2;
     printf( "Scale setup: %f\n" , scale );
     if( ! diddisplay ) SDL_BlitSurface( input , NULL , window , NULL );
-    render_scaled_image( displayobject , window , px , py , pw , ph );
+    if( ! r->warped || render_warped_image( displayobject , window , r->viewx , r->viewy , &r->viewtosprite ) )
+    {
+      int sw , sh;
+      const unsigned char * sprite = sprite_get( &sprites , scale , &sw , &sh , &frame );
+      if( sprite )
+        composite( sprite , sprites.pitch , window , indic.x - sw / 2 , indic.y - sh / 2 , sw , sh );
+      else
+        render_scaled_image( displayobject , window , px , py , pw , ph );
+    }
     SDL_Flip( window );
   }
-  free( cell->units );
-  free( cell );
-  free( squares );
+  // Stepping through debug mode would throw the estimate off
+  if( ! debugmode )
+    latency += ( seconds() - captured - latency ) * LATENCY_GAIN;
+}
+
+// Pose of the board, from where its corners are on the undistorted frame.
+// Also takes the calibration views. Returns non zero without intrinsics.
+int board_pose( FrameResult * r )
+{
+  float x[4] , y[4];
+  Homography h;
+  int i;
+  forrange( i , 4 )
+  {
+    x[i] = ( float ) r->board.x[i] / REFINE_ONE;
+    y[i] = ( float ) r->board.y[i] / REFINE_ONE;
+  }
+  if( homography_rect_to_quad( &h , BOARD_WIDTH , BOARD_HEIGHT , x , y ) ) return 1;
+  // Guessed corners would only mislead the solver
+  if( calibrating && ! r->degraded )
+  {
+    // Only views that differ enough tell the solver anything new
+    static int lastx[4] , lasty[4];
+    int moved = 0;
+    forrange( i , 4 )
+      moved += abs( ( r->board.x[i] >> REFINE_SHIFT ) - lastx[i] ) + abs( ( r->board.y[i] >> REFINE_SHIFT ) - lasty[i] );
+    if( ! calibration.views || moved > CALIB_MOTION )
+    {
+      forrange( i , 4 )
+      {
+        lastx[i] = r->board.x[i] >> REFINE_SHIFT;
+        lasty[i] = r->board.y[i] >> REFINE_SHIFT;
+      }
+      if( ! calib_add( &calibration , &h ) )
+        printf( "Calibration view %d taken.\n" , calibration.views );
+    }
+  }
+  if( camera.fx <= 0 ) return 1;
+  return pose_from_homography( &camera , &h , BOARD_WIDTH , BOARD_HEIGHT , &r->pose );
+}
+
+// Solves the intrinsics from the collected views, saves them to lens.cal and
+// rebuilds the lens table for them. Distortion is kept as it was.
+void finish_calibration()
+{
+  LensCalibration cal = camera;
+  int guarded;
+  if( calib_solve( &calibration , INPUT_WIDTH , &cal ) )
+  {
+    printf( "Calibration failed with %d views, need %d varied ones.\n" , calibration.views , CALIB_MIN_VIEWS );
+    return;
+  }
+  printf( "Calibrated from %d views: f %.1f %.1f c %.1f %.1f\n" , calibration.views , cal.fx , cal.fy , cal.cx , cal.cy );
+  if( lens_save_calibration( "./lens.cal" , &cal ) )
+    printf( "Failed to save lens.cal.\n" );
+  camera = cal;
+  // Rebuilding the table allocates
+  guarded = malloc_guard( 0 );
+  lens_close( &lens );
+  if( lens_open( &lens , &camera , "./lens.lut" , DS_WIDTH , DS_HEIGHT , DS_SCALE , INPUT_WIDTH , INPUT_HEIGHT ) )
+    printf( "Failed to set up the lens table, detecting on the distorted frame.\n" );
+  malloc_guard( guarded );
+}
+
+double seconds()
+{
+  struct timespec t;
+  clock_gettime( CLOCK_MONOTONIC , &t );
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Times labeling the current level 0 runs on 1 up to LABEL_THREADS threads.
+void bench_labeling()
+{
+  RunMask * rm = &levels[0].runs;
+  size_t mark = arena_mark( &frame );
+  int * parent = ( int * ) arena_alloc( &frame , ( rm->count + 1 ) * sizeof( int ) );
+  Blob * blobs = ( Blob * ) arena_alloc( &frame , sizeof( Blob ) * ( rm->count + 1 ) );
+  int threads , i , groups;
+  double start , single;
+  printf( "Labeling %d runs on a %dx%d grid:\n" , rm->count , rm->w , rm->h );
+  if( rm->count < 2 * MIN_STRIP_RUNS )
+    printf( "Fewer than %d runs, every count of threads labels as one strip.\n" , 2 * MIN_STRIP_RUNS );
+  for( threads = 1; threads <= LABEL_THREADS; threads++ )
+  {
+    start = seconds();
+    forrange( i , 100 )
+      groups = parlabel_runs( rm , connectivity , threads , NULL , parent , blobs );
+    start = ( seconds() - start ) / 100;
+    if( threads == 1 ) single = start;
+    printf( "%d threads: %d groups in %.1f us, %.2fx\n" , threads , groups , start * 1e6 , single / start );
+  }
+  arena_release( &frame , mark );
+}
+
+// Looks for the board where the tracks of the last one are first, and only
+// searches all the squares if it isn't there any more. ids are the track
+// ids of the squares. Returns non zero if there is no board.
+// With the board partly hidden, places the corners where the markers still
+// in view say they are, going by where all of them sat on the last full
+// board: three give an affine map, two a rotation, scale and shift, one a
+// shift. index has the squares of the corners in view and -1 for the rest.
+// Hidden corners with an unused square of about their size close to where
+// they should be get it back in index. Returns non zero if there is nothing to
+// go by.
+int estimate_board( const SquareTable * squares , int * index , Constellation * c )
+{
+  float sx[3] , sy[3] , dx[3] , dy[3] , a[6] , ux , uy , vx , vy , d , x , y , size , best , e;
+  int i , j , k , n = 0;
+  if( ! fullboard || degradedrun >= MAX_DEGRADED ) return 1;
+  forrange( i , 4 )
+  {
+    if( index[i] < 0 ) continue;
+    if( n == 3 ) return 1;
+    sx[n] = fullx[i];
+    sy[n] = fully[i];
+    dx[n] = ( float ) squares->fx[index[i]] / REFINE_ONE;
+    dy[n] = ( float ) squares->fy[index[i]] / REFINE_ONE;
+    n++;
+  }
+  if( ! n ) return 1;
+  if( n == 3 )
+  {
+    ux = sx[1] - sx[0]; uy = sy[1] - sy[0];
+    vx = sx[2] - sx[0]; vy = sy[2] - sy[0];
+    d = ux * vy - uy * vx;
+    if( fabsf( d ) < 1 ) n = 2;
+    else
+    {
+      a[0] = ( ( dx[1] - dx[0] ) * vy - ( dx[2] - dx[0] ) * uy ) / d;
+      a[1] = ( ( dx[2] - dx[0] ) * ux - ( dx[1] - dx[0] ) * vx ) / d;
+      a[3] = ( ( dy[1] - dy[0] ) * vy - ( dy[2] - dy[0] ) * uy ) / d;
+      a[4] = ( ( dy[2] - dy[0] ) * ux - ( dy[1] - dy[0] ) * vx ) / d;
+    }
+  }
+  if( n == 2 )
+  {
+    ux = sx[1] - sx[0]; uy = sy[1] - sy[0];
+    vx = dx[1] - dx[0]; vy = dy[1] - dy[0];
+    d = ux * ux + uy * uy;
+    if( d < 1 ) n = 1;
+    else
+    {
+      a[0] = a[4] = ( ux * vx + uy * vy ) / d;
+      a[3] = ( ux * vy - uy * vx ) / d;
+      a[1] = - a[3];
+    }
+  }
+  if( n == 1 )
+  {
+    a[0] = a[4] = 1;
+    a[1] = a[3] = 0;
+  }
+  a[2] = dx[0] - a[0] * sx[0] - a[1] * sy[0];
+  a[5] = dy[0] - a[3] * sx[0] - a[4] * sy[0];
+  forrange( i , 4 )
+  {
+    if( index[i] >= 0 )
+    {
+      c->x[i] = squares->fx[index[i]];
+      c->y[i] = squares->fy[index[i]];
+    }else
+    {
+      x = a[0] * fullx[i] + a[1] * fully[i] + a[2];
+      y = a[3] * fullx[i] + a[4] * fully[i] + a[5];
+      c->x[i] = x * REFINE_ONE + 0.5f;
+      c->y[i] = y * REFINE_ONE + 0.5f;
+      best = fullsize[i] * REACQUIRE_SIZES;
+      best *= best;
+      forrange( j , squares->count )
+      {
+        size = ( squares->w[j] + squares->h[j] ) / 2.0f;
+        if( size > fullsize[i] * MAX_SIZE_CHANGE || fullsize[i] > size * MAX_SIZE_CHANGE ) continue;
+        // Already a corner in view or taken back by another hidden one
+        forrange( k , 4 ) if( k != i && index[k] == j ) break;
+        if( k < 4 ) continue;
+        ux = ( float ) squares->fx[j] / REFINE_ONE - x;
+        uy = ( float ) squares->fy[j] / REFINE_ONE - y;
+        e = ux * ux + uy * uy;
+        if( e >= best ) continue;
+        best = e;
+        index[i] = j;
+      }
+    }
+    c->index[i] = index[i];
+    c->id[i] = boardids[i];
+  }
+  return 0;
+}
+
+// Looks for the board where the tracks of the last one are first. If only
+// some of them are left it is placed from those, and only without any is
+// every square searched. ids are the track ids of the squares, degraded is
+// set when the board was placed from fewer than four markers. Returns non
+// zero if there is no board.
+int find_board( SquareTable * squares , const int * ids , Constellation * c , int * degraded )
+{
+  int index[4];
+  int i , known = 1;
+  *degraded = 0;
+  forrange( i , 4 )
+  {
+    const Track * k = boardids[i] ? tracker_find( &tracker , boardids[i] ) : NULL;
+    index[i] = k ? k->square : -1;
+    if( index[i] < 0 ) known = 0;
+  }
+  if( known && ! match_known( squares , index , c ) ) goto found;
+  if( ! known && ! estimate_board( squares , index , c ) )
+  {
+    if( index[0] >= 0 && index[1] >= 0 && index[2] >= 0 && index[3] >= 0 &&
+        ! match_known( squares , index , c ) )
+      goto found;
+    *degraded = 1;
+    degradedrun++;
+    degradedframes++;
+    return 0;
+  }
+  if( match_constellation( squares , INPUT_WIDTH , INPUT_HEIGHT , c , &frame , &matchstats ) )
+    return 1;
+found:
+  forrange( i , 4 )
+  {
+    c->id[i] = ids[c->index[i]];
+    fullx[i] = ( float ) c->x[i] / REFINE_ONE;
+    fully[i] = ( float ) c->y[i] / REFINE_ONE;
+    fullsize[i] = ( squares->w[c->index[i]] + squares->h[c->index[i]] ) / 2.0f;
+  }
+  fullboard = 1;
+  degradedrun = 0;
+  return 0;
+}
+
+void create_groups()
+{
+  int squarecount;
+  int maxsquares = 0;
+  SquareTable squares;
+  result.found = 0;
+  // Until plan_windows knows better, the next frame looks at everything
+  windowcount = 0;
+  int l;
+  // Every group could become a square, and there are at most as many groups
+  // as runs or label table entries.
+  forrange( l , PYR_LEVELS )
+    maxsquares += runlabel ? levels[l].runs.count : label_table_size( levels[l].w , levels[l].h );
+  if( squares_init( &squares , &frame , maxsquares ) ) return;
+  forrange( l , PYR_LEVELS )
+  {
+    Level * lv = &levels[l];
+    size_t mark = arena_mark( &frame );
+    Blob * blobs;
+    int blobcount;
+    if( runlabel )
+    {
+      int * parent = ( int * ) arena_alloc( &frame , ( lv->runs.count + 1 ) * sizeof( int ) );
+      blobs = ( Blob * ) arena_alloc( &frame , sizeof( Blob ) * ( lv->runs.count + 1 ) );
+      blobcount = parlabel_runs( &lv->runs , connectivity , label_threads , &blobfilter , parent , blobs );
+    }else
+    {
+      Cell * cell = create_cell( lv );
+      blobs = ( Blob * ) arena_alloc( &frame , sizeof( Blob ) * label_table_size( cell->w , cell->h ) );
+      blobcount = filter_blobs( &blobfilter , blobs , unitize_cell( cell , blobs ) );
+    }
+    build_squares( lv , blobs , blobcount , &squares );
+    // The labeling scratch is done with, the next level can reuse it
+    arena_release( &frame , mark );
+  }
+  squarecount = merge_scales( &squares );
+  refine_squares( &squares );
+  // Only four squares are ever looked at, the table itself stays as it is.
+  // Without a board in view fall back on the best by size.
+  int pick[4];
+  int picked = 4;
+  int * ids = ( int * ) arena_alloc( &frame , squares.count * sizeof( int ) + 1 );
+  if( ! ids ) return;
+  tracker_update( &tracker , &squares , captured , ids , &frame );
+  result.found = ! find_board( &squares , ids , &result.board , &result.degraded ) &&
+                 ! board_homography( &result );
+  result.posed = result.found && ! board_pose( &result );
+  int x[4] , y[4];
+  int i;
+  if( result.found )
+  {
+    memcpy( x , result.board.x , sizeof( x ) );
+    memcpy( y , result.board.y , sizeof( y ) );
+    if( result.degraded )
+      printf( "Board partly hidden, %u frames so far.\n" , degradedframes );
+    else
+      printf( "Board found, cost %.3f, tracks %d %d %d %d.\n" , result.board.cost ,
+              result.board.id[0] , result.board.id[1] , result.board.id[2] , result.board.id[3] );
+  }else
+  {
+    picked = squares_top( &squares , avaragesort ? score_mean_size : score_size , 4 , pick , &frame );
+    forrange( i , picked )
+    {
+      x[i] = squares.fx[pick[i]];
+      y[i] = squares.fy[pick[i]];
+    }
+  }
+  printf( "Rendering\n" );
+  if( debugmode )
+  {
+    render_squares( &squares );
+    render_tracks();
+  }
+  // A partly hidden board still counts, however few squares are left
+  int measured = result.found || squarecount > 2;
+  if( measured )
+  {
+    if( debugmode && ! result.found )
+    {
+      render_center( &squares , pick , picked );
+      wait_for_next();
+    }
+    Indicator indic = get_indication( x , y , result.found ? 4 : picked );
+    result.indicator = indic;
+    printf("Indicator %d %d : %d\n" , indic.x , indic.y , indic.distance );
+  }
+  plan_windows( &result );
+  track_board( &result , measured );
+  present( &result );
   if( debugmode ) wait_for_next();
 }
 
@@ -748,9 +1595,17 @@ void video_loop()
   int i = 0;
   while( ! exitflag )
   {
+    arena_reset( &frame );
+    arena_reset( &outlines );
+    // Everything the loop needs exists by now, any allocation is a leak
+    // or churn waiting to happen.
+    if( i == WARMUP_FRAMES ) malloc_guard( 1 );
     diddisplay = 0;
     printf( "======= INTERATION %d =======\n" , i++ );
     take_frame( (byte * )pixels );
+    double now = seconds();
+    if( captured ) frametime += ( now - captured - frametime ) * LATENCY_GAIN;
+    captured = now;
     if( debugmode )
     {
       update_texture();
@@ -767,9 +1622,19 @@ void video_loop()
 void quit_test(  )
 {
   printf( "Shutting down camera.\n" );
+  malloc_guard( 0 );
   end_cam();
+  printf( "Frame arena peak: %u of %u bytes.\n" , ( unsigned ) frame.peak , ( unsigned ) frame.size );
+  filter_report( &blobfilter );
+  match_report( &matchstats );
+  lens_close( &lens );
+  parlabel_quit();
   printf( "Quitting SDL.\n" );
   SDL_FreeSurface( input );
+  free( overlaypixels );
+  SDL_FreeSurface( dsview );
+  printf( "Sprite cache: %u hits, %u misses.\n" , sprites.hits , sprites.misses );
+  sprite_free( &sprites );
   SDL_FreeSurface( window );
   SDL_Quit();
   printf( "Quit.\n" );
@@ -0,0 +1,111 @@
+#include <string.h>
+#include "include/warp.h"
+
+// Draws an RGBA image through a homography.
+//
+// The homography maps destination pixels onto the image. Along a row its
+// numerators and denominator change by a constant each pixel, so only the
+// ends of every SPAN pixels are divided out exactly and the texture
+// coordinates in between are stepped linearly in 16.16 fixed point. A span
+// is short enough that the error stays well under a texel for anything but
+// a board seen nearly edge on.
+
+#define SPAN 16
+// Texture coordinates further off the image than this are clamped. Going
+// from -FAR to FAR in a single pixel still has to fit an int in 16.16, so
+// 2 * FAR * 65536 stays under 2^31 with room for rounding. Images have to
+// be smaller than this.
+#define FAR 8000.0f
+
+static float clampf( float v )
+{
+  return v < -FAR ? -FAR : ( v > FAR ? FAR : v );
+}
+
+typedef unsigned int u32;
+
+// Texel (x, y) clamped to the image.
+static u32 texel( const unsigned char * src , int sw , int sh , int spitch , int x , int y )
+{
+  x = x < 0 ? 0 : ( x >= sw ? sw - 1 : x );
+  y = y < 0 ? 0 : ( y >= sh ? sh - 1 : y );
+  return *( const u32 * ) ( src + y * spitch + x * 4 );
+}
+
+// Mixes every byte of a and b, t in 0 to 256. Two bytes at a time, each
+// product fits its 16 bit lane.
+static u32 lerp( u32 a , u32 b , int t )
+{
+  u32 rb = ( ( a & 0x00FF00FF ) * ( 256 - t ) + ( b & 0x00FF00FF ) * t ) >> 8;
+  u32 ga = ( ( a >> 8 & 0x00FF00FF ) * ( 256 - t ) + ( b >> 8 & 0x00FF00FF ) * t ) >> 8;
+  return ( rb & 0x00FF00FF ) | ( ( ga & 0x00FF00FF ) << 8 );
+}
+
+// Texture coordinates are 16.16 with texel centres at halves, and have to
+// be on the image.
+static u32 sample( const unsigned char * src , int sw , int sh , int spitch , int u , int v , int flags )
+{
+  int x , y;
+  if( ! ( flags & WARP_BILINEAR ) )
+    return texel( src , sw , sh , spitch , u >> 16 , v >> 16 );
+  u -= 1 << 15;
+  v -= 1 << 15;
+  x = u >> 16;
+  y = v >> 16;
+  int fx = ( u >> 8 ) & 0xFF , fy = ( v >> 8 ) & 0xFF;
+  u32 top = lerp( texel( src , sw , sh , spitch , x , y ) , texel( src , sw , sh , spitch , x + 1 , y ) , fx );
+  u32 bottom = lerp( texel( src , sw , sh , spitch , x , y + 1 ) , texel( src , sw , sh , spitch , x + 1 , y + 1 ) , fx );
+  return lerp( top , bottom , fy );
+}
+
+// Fills the w by h block of dst whose first pixel is (ox, oy) on the
+// destination, with what the homography tosrc maps each pixel centre onto
+// in src. Everything off the image is left fully transparent. Both images
+// are 32 bit with alpha in the top byte.
+void warp_image( const unsigned char * src , int sw , int sh , int spitch ,
+                 unsigned char * dst , int dpitch , int ox , int oy , int w , int h ,
+                 const Homography * tosrc , int flags )
+{
+  const float * m = tosrc->m;
+  u32 opaque = flags & WARP_BLEND ? 0 : 0xFF000000;
+  int i , j , k , n , fu , fv , du , dv;
+  for( j = 0; j < h; j++ )
+  {
+    u32 * row = ( u32 * ) ( dst + j * dpitch );
+    float x = ox + 0.5f , y = oy + j + 0.5f;
+    float U = m[0] * x + m[1] * y + m[2];
+    float V = m[3] * x + m[4] * y + m[5];
+    float W = m[6] * x + m[7] * y + m[8];
+    float u0 = clampf( U / W ) , v0 = clampf( V / W ) , u1 , v1;
+    for( i = 0; i < w; i += n )
+    {
+      n = w - i < SPAN ? w - i : SPAN;
+      int behind = W <= 0;
+      U += m[0] * n;
+      V += m[3] * n;
+      W += m[6] * n;
+      u1 = clampf( U / W );
+      v1 = clampf( V / W );
+      if( behind || W <= 0 )
+      {
+        // The board's horizon runs through here
+        memset( row + i , 0 , n * sizeof( u32 ) );
+      }else
+      {
+        fu = u0 * 65536;
+        fv = v0 * 65536;
+        du = ( u1 - u0 ) * 65536 / n;
+        dv = ( v1 - v0 ) * 65536 / n;
+        for( k = 0; k < n; k++ , fu += du , fv += dv )
+        {
+          if( fu < 0 || fv < 0 || ( fu >> 16 ) >= sw || ( fv >> 16 ) >= sh )
+            row[i+k] = 0;
+          else
+            row[i+k] = sample( src , sw , sh , spitch , fu , fv , flags ) | opaque;
+        }
+      }
+      u0 = u1;
+      v0 = v1;
+    }
+  }
+}